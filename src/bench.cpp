@@ -0,0 +1,87 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "first_app.hpp"
+
+// renders a generated scene offscreen for a fixed number of frames and
+// writes the results as JSON, so that runs can be compared over time. It
+// needs no display, a software driver such as lavapipe will do. With
+// --mesh the models come from mesh files, e.g. written by mesh_convert
+int main( int argc, char** argv ) {
+  lve::AppConfig config{};
+  config.headless = true;
+  config.frameCount = 500;
+  config.useBenchmarkScene = true;
+  config.fixedSimulationSteps = true;
+  config.reportPath = "bench_results.json";
+
+  lve::BenchmarkScene& scene = config.benchmarkScene;
+  for ( int i = 1; i < argc; i++ ) {
+    bool hasValue = i + 1 < argc;
+    if ( strcmp( argv[i], "--objects" ) == 0 && hasValue ) {
+      scene.objectCount = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--models" ) == 0 && hasValue ) {
+      scene.modelCount = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--unique-models" ) == 0 && hasValue ) {
+      scene.uniqueModelCount =
+          static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--depth" ) == 0 && hasValue ) {
+      scene.sierpinskiDepth =
+          static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--seed" ) == 0 && hasValue ) {
+      scene.seed = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--frames" ) == 0 && hasValue ) {
+      config.frameCount = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--output" ) == 0 && hasValue ) {
+      config.reportPath = argv[++i];
+    } else if ( strcmp( argv[i], "--per-object" ) == 0 ) {
+      config.renderMode = lve::RenderMode::PerObject;
+    } else if ( strcmp( argv[i], "--indirect" ) == 0 ) {
+      config.renderMode = lve::RenderMode::Indirect;
+    } else if ( strcmp( argv[i], "--vertex-format" ) == 0 && hasValue &&
+                lve::parseVertexFormat( argv[i + 1], config.vertexFormat ) ) {
+      i++;
+    } else if ( strcmp( argv[i], "--stream" ) == 0 ) {
+      config.streamModels = true;
+    } else if ( strcmp( argv[i], "--dynamic" ) == 0 ) {
+      config.dynamicGeometry = true;
+    } else if ( strcmp( argv[i], "--wait-idle" ) == 0 ) {
+      config.waitIdleEachFrame = true;
+    } else if ( strcmp( argv[i], "--mesh" ) == 0 && hasValue ) {
+      config.meshPaths.push_back( argv[++i] );
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--objects N] [--models M] [--unique-models U]"
+                   " [--depth D] [--seed S]"
+                   " [--frames F] [--output PATH]"
+                   " [--per-object | --indirect]"
+                   " [--vertex-format float|snorm16|half] [--mesh PATH]..."
+                   " [--stream] [--dynamic] [--wait-idle]"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // deeper doesn't fit into memory, and larger values would wrap around
+  if ( scene.sierpinskiDepth > lve::SIERPINSKI_MAX_DEPTH ) {
+    std::cerr << "depth is at most " << int( lve::SIERPINSKI_MAX_DEPTH )
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // without a window nothing would ever stop a run of 0 frames
+  if ( config.frameCount == 0 ) config.frameCount = 1;
+
+  try {
+    lve::FirstApp app{ config };
+    app.run();
+  } catch ( const std::exception& e ) {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
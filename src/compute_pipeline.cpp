@@ -0,0 +1,73 @@
+#include "compute_pipeline.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "pipeline.hpp"
+
+namespace lve {
+
+ComputePipeline::ComputePipeline(
+    Device& _device, const std::string& compFilePath,
+    VkPipelineLayout pipelineLayout )
+    : device{ _device } {
+  createComputePipeline( compFilePath, pipelineLayout );
+}
+
+ComputePipeline::~ComputePipeline() {
+  vkDestroyShaderModule( device.device(), compShaderModule, nullptr );
+
+  // may still be bound in frames in flight
+  VkDevice owner = device.device();
+  VkPipeline pipeline = computePipeline;
+  device.deferDestruction( [owner, pipeline]() {
+    vkDestroyPipeline( owner, pipeline, nullptr );
+  } );
+}
+
+void ComputePipeline::createComputePipeline(
+    const std::string& compFilePath, VkPipelineLayout pipelineLayout ) {
+  auto compCode = Pipeline::readFile( compFilePath );
+
+  VkShaderModuleCreateInfo moduleInfo{};
+  moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  moduleInfo.codeSize = compCode.size();
+  moduleInfo.pCode = reinterpret_cast< const uint32_t* >( compCode.data() );
+
+  if ( vkCreateShaderModule(
+           device.device(), &moduleInfo, nullptr, &compShaderModule ) !=
+       VK_SUCCESS ) {
+    throw std::runtime_error( "failed to create shader module" );
+  }
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = compShaderModule;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.layout = pipelineLayout;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+  pipelineInfo.basePipelineIndex = -1;
+
+  auto start = std::chrono::steady_clock::now();
+
+  if ( vkCreateComputePipelines(
+           device.device(), device.pipelineCache(), 1, &pipelineInfo,
+           nullptr, &computePipeline ) != VK_SUCCESS ) {
+    throw std::runtime_error( "failed to create compute pipeline" );
+  }
+
+  device.recordPipelineCreation(
+      std::chrono::duration< double, std::milli >(
+          std::chrono::steady_clock::now() - start )
+          .count() );
+}
+
+void ComputePipeline::bind( VkCommandBuffer commandBuffer ) {
+  vkCmdBindPipeline(
+      commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline );
+}
+
+}  // namespace lve
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+#include "device.hpp"
+
+namespace lve {
+
+// a compute shader and its pipeline; the layout is owned by the caller, like
+// for Pipeline
+class ComputePipeline {
+ private:
+  Device& device;
+
+  VkPipeline computePipeline;
+  VkShaderModule compShaderModule;
+
+  void createComputePipeline( const std::string&, VkPipelineLayout );
+
+ public:
+  ComputePipeline( Device&, const std::string&, VkPipelineLayout );
+  ~ComputePipeline();
+  ComputePipeline( const ComputePipeline& ) = delete;
+  ComputePipeline& operator=( const ComputePipeline& ) = delete;
+
+  void bind( VkCommandBuffer );
+};
+
+}  // namespace lve
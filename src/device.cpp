@@ -1,11 +1,18 @@
 #include "device.hpp"
 
 // std headers
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
 
+#include "geometry_pool.hpp"
+#include "upload_batch.hpp"
+
 namespace lve {
 
 // local callback functions
@@ -43,7 +50,9 @@ void DestroyDebugUtilsMessengerEXT(
 }
 
 // class member functions
-Device::Device( Window &window ) : window{ window } {
+Device::Device( Window *window ) : window{ window } {
+  if ( isHeadless() ) deviceExtensions.clear();
+
   // create instance
   createInstance();
 
@@ -59,11 +68,46 @@ Device::Device( Window &window ) : window{ window } {
   // abstraction layer for features of the graphics device
   createLogicalDevice();
 
+  // sub-allocates buffer and image memory out of large blocks
+  allocator = std::make_unique< MemoryAllocator >( device_, physicalDevice );
+
   // set up command pool for command buffers (which will be explained later)
   createCommandPool();
+
+  // persistently mapped buffer that all uploads are staged through
+  createStagingRing();
+
+  // one vertex and one index buffer that all models share
+  createGeometryPool();
+
+  // compiled pipelines from previous runs
+  createPipelineCache();
 }
 
 Device::~Device() {
+  // everything still queued may reference memory from the allocator
+  vkDeviceWaitIdle( device_ );
+  frameCompleted( currentFrameNumber );
+  geometryPool_ = nullptr;
+
+  savePipelineCache();
+  vkDestroyPipelineCache( device_, pipelineCache_, nullptr );
+
+  collectUploads( true );
+  for ( auto fence: freeUploadFences ) {
+    vkDestroyFence( device_, fence, nullptr );
+  }
+  for ( auto semaphore: freeUploadSemaphores ) {
+    vkDestroySemaphore( device_, semaphore, nullptr );
+  }
+  stagingRing = nullptr;
+  vkDestroyBuffer( device_, stagingBuffer, nullptr );
+  freeMemory( stagingAllocation );
+
+  allocator = nullptr;
+  if ( transferCommandPool != commandPool ) {
+    vkDestroyCommandPool( device_, transferCommandPool, nullptr );
+  }
   vkDestroyCommandPool( device_, commandPool, nullptr );
   vkDestroyDevice( device_, nullptr );
 
@@ -71,7 +115,9 @@ Device::~Device() {
     DestroyDebugUtilsMessengerEXT( instance, debugMessenger, nullptr );
   }
 
-  vkDestroySurfaceKHR( instance, surface_, nullptr );
+  if ( surface_ != VK_NULL_HANDLE ) {
+    vkDestroySurfaceKHR( instance, surface_, nullptr );
+  }
   vkDestroyInstance( instance, nullptr );
 }
 
@@ -145,10 +191,12 @@ void Device::pickPhysicalDevice() {
 
 void Device::createLogicalDevice() {
   QueueFamilyIndices indices = findQueueFamilies( physicalDevice );
+  queueFamilyIndices = indices;
 
   std::vector< VkDeviceQueueCreateInfo > queueCreateInfos;
   std::set< uint32_t > uniqueQueueFamilies = { indices.graphicsFamily,
-                                               indices.presentFamily };
+                                               indices.presentFamily,
+                                               indices.transferFamily };
 
   float queuePriority = 1.0f;
   for ( uint32_t queueFamily: uniqueQueueFamilies ) {
@@ -163,6 +211,19 @@ void Device::createLogicalDevice() {
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+  // lets indirect draws of many models go out in one call; without it each
+  // takes a call of its own
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures( physicalDevice, &supportedFeatures );
+  deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+  multiDrawIndirectEnabled = supportedFeatures.multiDrawIndirect == VK_TRUE;
+  // indirect draws that start past the first instance; without it each
+  // draw has to bind its instances at an offset instead
+  deviceFeatures.drawIndirectFirstInstance =
+      supportedFeatures.drawIndirectFirstInstance;
+  drawIndirectFirstInstanceEnabled =
+      supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
@@ -170,10 +231,31 @@ void Device::createLogicalDevice() {
       static_cast< uint32_t >( queueCreateInfos.size() );
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+  // present timing is only used for latency measurements, so it's fine to
+  // go without it
+  std::vector< const char* > enabledExtensions = deviceExtensions;
+  if ( !isHeadless() ) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(
+        physicalDevice, nullptr, &extensionCount, nullptr );
+    std::vector< VkExtensionProperties > availableExtensions( extensionCount );
+    vkEnumerateDeviceExtensionProperties(
+        physicalDevice, nullptr, &extensionCount, availableExtensions.data() );
+
+    for ( const auto &extension: availableExtensions ) {
+      if ( strcmp(
+               extension.extensionName,
+               VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME ) == 0 ) {
+        enabledExtensions.push_back( VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME );
+        displayTimingEnabled = true;
+      }
+    }
+  }
+
   createInfo.pEnabledFeatures = &deviceFeatures;
   createInfo.enabledExtensionCount =
-      static_cast< uint32_t >( deviceExtensions.size() );
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+      static_cast< uint32_t >( enabledExtensions.size() );
+  createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
   // might not really be necessary anymore because device specific validation
   // layers have been deprecated
@@ -192,6 +274,12 @@ void Device::createLogicalDevice() {
 
   vkGetDeviceQueue( device_, indices.graphicsFamily, 0, &graphicsQueue_ );
   vkGetDeviceQueue( device_, indices.presentFamily, 0, &presentQueue_ );
+  vkGetDeviceQueue( device_, indices.transferFamily, 0, &transferQueue_ );
+
+  if ( indices.hasDedicatedTransfer() ) {
+    std::cout << "transfer queue family: " << indices.transferFamily
+              << std::endl;
+  }
 }
 
 void Device::createCommandPool() {
@@ -207,10 +295,141 @@ void Device::createCommandPool() {
        VK_SUCCESS ) {
     throw std::runtime_error( "failed to create command pool!" );
   }
+
+  // command buffers can only be submitted to queues of the family their pool
+  // was created for
+  transferCommandPool = commandPool;
+  if ( queueFamilyIndices.hasDedicatedTransfer() ) {
+    poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+    if ( vkCreateCommandPool(
+             device_, &poolInfo, nullptr, &transferCommandPool ) !=
+         VK_SUCCESS ) {
+      throw std::runtime_error( "failed to create transfer command pool!" );
+    }
+  }
+}
+
+void Device::createStagingRing() {
+  createBuffer(
+      STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      stagingBuffer, stagingAllocation );
+
+  stagingRing = std::make_unique< StagingRing >(
+      stagingBuffer, stagingAllocation.mapped, STAGING_RING_SIZE );
+}
+
+void Device::createGeometryPool() {
+  geometryPool_ = std::make_unique< GeometryPool >( *this );
+}
+
+bool Device::isPipelineCacheCompatible( const std::vector< char > &data ) {
+  // the data starts with a header describing who wrote it:
+  //   uint32_t headerSize, uint32_t headerVersion, uint32_t vendorID,
+  //   uint32_t deviceID, uint8_t pipelineCacheUUID[VK_UUID_SIZE]
+  // drivers are supposed to reject foreign data themselves, but not all of
+  // them do so gracefully
+  const size_t headerSize = 16 + VK_UUID_SIZE;
+  if ( data.size() < headerSize ) return false;
+
+  uint32_t header[4];
+  memcpy( header, data.data(), sizeof( header ) );
+
+  return header[0] >= headerSize &&
+         header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header[2] == properties.vendorID &&
+         header[3] == properties.deviceID &&
+         memcmp(
+             data.data() + 16, properties.pipelineCacheUUID,
+             VK_UUID_SIZE ) == 0;
+}
+
+void Device::createPipelineCache() {
+  std::vector< char > data;
+
+  std::ifstream file{ PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary };
+  if ( file.is_open() ) {
+    data.resize( static_cast< size_t >( file.tellg() ) );
+    file.seekg( 0 );
+    file.read( data.data(), data.size() );
+    file.close();
+
+    if ( !isPipelineCacheCompatible( data ) ) {
+      std::cout << "pipeline cache was written by a different device or "
+                   "driver, ignoring it"
+                << std::endl;
+      data.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = data.size();
+  cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+  if ( vkCreatePipelineCache( device_, &cacheInfo, nullptr, &pipelineCache_ ) !=
+       VK_SUCCESS ) {
+    throw std::runtime_error( "failed to create pipeline cache!" );
+  }
+
+  pipelineCacheStats.warm = !data.empty();
+}
+
+void Device::savePipelineCache() {
+  const PipelineCacheStats &stats = pipelineCacheStats;
+  std::cout << "pipeline cache (" << ( stats.warm ? "warm" : "cold" )
+            << "): " << stats.pipelinesCreated << " pipeline(s) created in "
+            << stats.creationMilliseconds << " ms, first one took "
+            << stats.firstCreationMilliseconds << " ms" << std::endl;
+
+  size_t size = 0;
+  if ( vkGetPipelineCacheData( device_, pipelineCache_, &size, nullptr ) !=
+           VK_SUCCESS ||
+       size == 0 ) {
+    return;
+  }
+
+  std::vector< char > data( size );
+  if ( vkGetPipelineCacheData(
+           device_, pipelineCache_, &size, data.data() ) != VK_SUCCESS ) {
+    return;
+  }
+
+  // write to a temporary file and rename it over the old cache, so a crash
+  // halfway through never leaves a truncated cache behind
+  std::string temporaryPath = std::string( PIPELINE_CACHE_PATH ) + ".tmp";
+  std::ofstream file{ temporaryPath, std::ios::binary | std::ios::trunc };
+  if ( !file.is_open() ) return;
+
+  file.write( data.data(), size );
+  file.close();
+
+  if ( !file || std::rename( temporaryPath.c_str(), PIPELINE_CACHE_PATH ) ) {
+    std::cerr << "failed to write pipeline cache" << std::endl;
+    std::remove( temporaryPath.c_str() );
+  }
+}
+
+void Device::frameCompleted( uint64_t frameNumber ) {
+  completedFrameNumber = std::max( completedFrameNumber, frameNumber );
+
+  // entries are queued in frame order
+  while ( !deferredDestructions.empty() &&
+          deferredDestructions.front().frameNumber <= completedFrameNumber ) {
+    deferredDestructions.front().destroy();
+    deferredDestructions.pop_front();
+  }
+}
+
+void Device::deferDestruction( std::function< void() > destroy ) {
+  deferredDestructions.push_back(
+      { currentFrameNumber, std::move( destroy ) } );
 }
 
 void Device::createSurface() {
-  window.createWindowSurface( instance, &surface_ );
+  if ( isHeadless() ) return;
+  window->createWindowSurface( instance, &surface_ );
 }
 
 bool Device::isDeviceSuitable( VkPhysicalDevice device ) {
@@ -218,8 +437,9 @@ bool Device::isDeviceSuitable( VkPhysicalDevice device ) {
 
   bool extensionsSupported = checkDeviceExtensionSupport( device );
 
-  bool swapChainAdequate = false;
-  if ( extensionsSupported ) {
+  // nothing is ever presented without a window
+  bool swapChainAdequate = isHeadless();
+  if ( extensionsSupported && !isHeadless() ) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport( device );
     swapChainAdequate = !swapChainSupport.formats.empty() &&
                         !swapChainSupport.presentModes.empty();
@@ -281,12 +501,16 @@ bool Device::checkValidationLayerSupport() {
 }
 
 std::vector< const char * > Device::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions( &glfwExtensionCount );
-
-  std::vector< const char * > extensions(
-      glfwExtensions, glfwExtensions + glfwExtensionCount );
+  std::vector< const char * > extensions;
+
+  // glfw isn't even initialized without a window, and no surface extensions
+  // are needed then
+  if ( !isHeadless() ) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions( &glfwExtensionCount );
+    extensions.assign( glfwExtensions, glfwExtensions + glfwExtensionCount );
+  }
 
   if ( enableValidationLayers ) {
     extensions.push_back( VK_EXT_DEBUG_UTILS_EXTENSION_NAME );
@@ -356,9 +580,13 @@ QueueFamilyIndices Device::findQueueFamilies( VkPhysicalDevice device ) {
       indices.graphicsFamily = i;
       indices.graphicsFamilyHasValue = true;
     }
-    VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(
-        device, i, surface_, &presentSupport );
+    // headless "presents" by rendering into offscreen images on the
+    // graphics queue
+    VkBool32 presentSupport = isHeadless() && indices.graphicsFamilyHasValue;
+    if ( !isHeadless() ) {
+      vkGetPhysicalDeviceSurfaceSupportKHR(
+          device, i, surface_, &presentSupport );
+    }
     if ( queueFamily.queueCount > 0 && presentSupport ) {
       indices.presentFamily = i;
       indices.presentFamilyHasValue = true;
@@ -370,6 +598,30 @@ QueueFamilyIndices Device::findQueueFamilies( VkPhysicalDevice device ) {
     i++;
   }
 
+  // prefer a family that only does transfers (the copy engine), then any
+  // family without graphics
+  int bestScore = 0;
+  for ( uint32_t j = 0; j < queueFamilies.size(); j++ ) {
+    VkQueueFlags flags = queueFamilies[j].queueFlags;
+    if ( queueFamilies[j].queueCount == 0 ||
+         !( flags & VK_QUEUE_TRANSFER_BIT ) ||
+         ( flags & VK_QUEUE_GRAPHICS_BIT ) ) {
+      continue;
+    }
+
+    int score = ( flags & VK_QUEUE_COMPUTE_BIT ) ? 1 : 2;
+    if ( score > bestScore ) {
+      bestScore = score;
+      indices.transferFamily = j;
+      indices.transferFamilyHasValue = true;
+    }
+  }
+
+  if ( !indices.transferFamilyHasValue && indices.graphicsFamilyHasValue ) {
+    indices.transferFamily = indices.graphicsFamily;
+    indices.transferFamilyHasValue = true;
+  }
+
   return indices;
 }
 
@@ -420,25 +672,10 @@ VkFormat Device::findSupportedFormat(
   throw std::runtime_error( "failed to find supported format!" );
 }
 
-uint32_t Device::findMemoryType(
-    uint32_t typeFilter, VkMemoryPropertyFlags properties ) {
-  VkPhysicalDeviceMemoryProperties memProperties;
-  vkGetPhysicalDeviceMemoryProperties( physicalDevice, &memProperties );
-  for ( uint32_t i = 0; i < memProperties.memoryTypeCount; i++ ) {
-    if ( ( typeFilter & ( 1 << i ) ) &&
-         ( memProperties.memoryTypes[i].propertyFlags & properties ) ==
-             properties ) {
-      return i;
-    }
-  }
-
-  throw std::runtime_error( "failed to find suitable memory type!" );
-}
-
 void Device::createBuffer(
     VkDeviceSize size, VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties, VkBuffer &buffer,
-    VkDeviceMemory &bufferMemory ) {
+    Allocation &bufferAllocation ) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
@@ -453,18 +690,10 @@ void Device::createBuffer(
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements( device_, buffer, &memRequirements );
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex =
-      findMemoryType( memRequirements.memoryTypeBits, properties );
+  bufferAllocation = allocator->allocate( memRequirements, properties, true );
 
-  if ( vkAllocateMemory( device_, &allocInfo, nullptr, &bufferMemory ) !=
-       VK_SUCCESS ) {
-    throw std::runtime_error( "failed to allocate vertex buffer memory!" );
-  }
-
-  vkBindBufferMemory( device_, buffer, bufferMemory, 0 );
+  vkBindBufferMemory(
+      device_, buffer, bufferAllocation.memory, bufferAllocation.offset );
 }
 
 VkCommandBuffer Device::beginSingleTimeCommands() {
@@ -493,52 +722,262 @@ void Device::endSingleTimeCommands( VkCommandBuffer commandBuffer ) {
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit( graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE );
-  vkQueueWaitIdle( graphicsQueue_ );
+  // wait for just this submission rather than idling the whole queue
+  VkFence fence = getUploadFence();
+  vkQueueSubmit( graphicsQueue_, 1, &submitInfo, fence );
+  vkWaitForFences( device_, 1, &fence, VK_TRUE, UINT64_MAX );
+  vkResetFences( device_, 1, &fence );
+  freeUploadFences.push_back( fence );
 
   vkFreeCommandBuffers( device_, commandPool, 1, &commandBuffer );
 }
 
-void Device::copyBuffer(
-    VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size ) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+bool Device::tryAcquireStagingRegion(
+    VkDeviceSize size, VkDeviceSize alignment, StagingRegion &region ) {
+  collectUploads();
+  return stagingRing->allocate( size, alignment, region );
+}
 
-  VkBufferCopy copyRegion{};
-  copyRegion.srcOffset = 0;  // Optional
-  copyRegion.dstOffset = 0;  // Optional
-  copyRegion.size = size;
-  vkCmdCopyBuffer( commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion );
+StagingRegion Device::acquireStagingRegion(
+    VkDeviceSize size, VkDeviceSize alignment ) {
+  StagingRegion region;
+  collectUploads();
+
+  while ( !stagingRing->allocate( size, alignment, region ) ) {
+    // the ring is full of data the GPU hasn't consumed yet; wait for the
+    // oldest upload and try again
+    assert( !pendingUploads.empty() && "Staging ring is full but idle" );
+    vkWaitForFences(
+        device_, 1, &pendingUploads.front().fence, VK_TRUE, UINT64_MAX );
+    collectUploads();
+  }
 
-  endSingleTimeCommands( commandBuffer );
+  return region;
 }
 
-void Device::copyBufferToImage(
-    VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
-    uint32_t layerCount ) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+VkFence Device::getUploadFence() {
+  if ( !freeUploadFences.empty() ) {
+    VkFence fence = freeUploadFences.back();
+    freeUploadFences.pop_back();
+    return fence;
+  }
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
-  VkBufferImageCopy region{};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
+  VkFence fence;
+  if ( vkCreateFence( device_, &fenceInfo, nullptr, &fence ) != VK_SUCCESS ) {
+    throw std::runtime_error( "failed to create upload fence!" );
+  }
+  return fence;
+}
 
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = layerCount;
+VkSemaphore Device::getUploadSemaphore() {
+  if ( !freeUploadSemaphores.empty() ) {
+    VkSemaphore semaphore = freeUploadSemaphores.back();
+    freeUploadSemaphores.pop_back();
+    return semaphore;
+  }
 
-  region.imageOffset = { 0, 0, 0 };
-  region.imageExtent = { width, height, 1 };
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-  vkCmdCopyBufferToImage(
-      commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-      &region );
-  endSingleTimeCommands( commandBuffer );
+  VkSemaphore semaphore;
+  if ( vkCreateSemaphore( device_, &semaphoreInfo, nullptr, &semaphore ) !=
+       VK_SUCCESS ) {
+    throw std::runtime_error( "failed to create upload semaphore!" );
+  }
+  return semaphore;
+}
+
+VkCommandBuffer Device::beginTransferCommands() {
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandPool = transferCommandPool;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer;
+  vkAllocateCommandBuffers( device_, &allocInfo, &commandBuffer );
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  vkBeginCommandBuffer( commandBuffer, &beginInfo );
+  return commandBuffer;
+}
+
+UploadTicket Device::submitUpload(
+    VkCommandBuffer commandBuffer,
+    std::vector< VkBufferMemoryBarrier > &bufferBarriers,
+    std::vector< VkImageMemoryBarrier > &imageBarriers ) {
+  QueueFamilyIndices &indices = queueFamilyIndices;
+  PendingUpload upload{};
+  upload.commandBuffer = commandBuffer;
+  upload.fence = getUploadFence();
+
+  uint32_t srcFamily = VK_QUEUE_FAMILY_IGNORED;
+  uint32_t dstFamily = VK_QUEUE_FAMILY_IGNORED;
+  if ( indices.hasDedicatedTransfer() ) {
+    srcFamily = indices.transferFamily;
+    dstFamily = indices.graphicsFamily;
+  }
+
+  // buffers are read as vertex/index data, images by the fragment shader
+  VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+  if ( !imageBarriers.empty() ) {
+    dstStages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  }
+
+  for ( auto &barrier: bufferBarriers ) {
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    barrier.srcQueueFamilyIndex = srcFamily;
+    barrier.dstQueueFamilyIndex = dstFamily;
+  }
+  for ( auto &barrier: imageBarriers ) {
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.srcQueueFamilyIndex = srcFamily;
+    barrier.dstQueueFamilyIndex = dstFamily;
+  }
+
+  uint32_t bufferBarrierCount =
+      static_cast< uint32_t >( bufferBarriers.size() );
+  uint32_t imageBarrierCount = static_cast< uint32_t >( imageBarriers.size() );
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &upload.commandBuffer;
+
+  if ( !indices.hasDedicatedTransfer() ) {
+    // same queue as the draws, so a barrier is all that is needed for them
+    // to see the data
+    vkCmdPipelineBarrier(
+        commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages, 0, 0,
+        nullptr, bufferBarrierCount, bufferBarriers.data(), imageBarrierCount,
+        imageBarriers.data() );
+    vkEndCommandBuffer( commandBuffer );
+
+    if ( vkQueueSubmit( graphicsQueue_, 1, &submitInfo, upload.fence ) !=
+         VK_SUCCESS ) {
+      throw std::runtime_error( "failed to submit upload!" );
+    }
+  } else {
+    // buffers and images are exclusive to one queue family, so the transfer
+    // queue has to release what it wrote and the graphics queue has to
+    // acquire it before the draws may read it. Both halves use identical
+    // barriers; the access masks that don't apply on a side are ignored.
+
+    // release
+    vkCmdPipelineBarrier(
+        commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+        bufferBarrierCount, bufferBarriers.data(), imageBarrierCount,
+        imageBarriers.data() );
+    vkEndCommandBuffer( commandBuffer );
+
+    upload.semaphore = getUploadSemaphore();
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &upload.semaphore;
+    if ( vkQueueSubmit( transferQueue_, 1, &submitInfo, VK_NULL_HANDLE ) !=
+         VK_SUCCESS ) {
+      throw std::runtime_error( "failed to submit upload!" );
+    }
+
+    // acquire
+    upload.acquireCommandBuffer = beginSingleTimeCommands();
+    vkCmdPipelineBarrier(
+        upload.acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        dstStages, 0, 0, nullptr, bufferBarrierCount, bufferBarriers.data(),
+        imageBarrierCount, imageBarriers.data() );
+    vkEndCommandBuffer( upload.acquireCommandBuffer );
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo acquireInfo{};
+    acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    acquireInfo.waitSemaphoreCount = 1;
+    acquireInfo.pWaitSemaphores = &upload.semaphore;
+    acquireInfo.pWaitDstStageMask = &waitStage;
+    acquireInfo.commandBufferCount = 1;
+    acquireInfo.pCommandBuffers = &upload.acquireCommandBuffer;
+
+    // the fence goes on the acquire, which can only finish after the copy
+    if ( vkQueueSubmit( graphicsQueue_, 1, &acquireInfo, upload.fence ) !=
+         VK_SUCCESS ) {
+      throw std::runtime_error( "failed to submit upload acquire!" );
+    }
+  }
+
+  upload.submission = ++submittedUploads;
+  stagingRing->close( upload.submission );
+  pendingUploads.push_back( upload );
+
+  return UploadTicket{ upload.submission };
+}
+
+UploadTicket Device::uploadToBuffer(
+    VkBuffer dstBuffer, const void *data, VkDeviceSize size,
+    VkDeviceSize dstOffset ) {
+  UploadBatch batch{ *this };
+  batch.uploadToBuffer( dstBuffer, data, size, dstOffset );
+  return batch.flush();
+}
+
+bool Device::isUploadComplete( UploadTicket ticket ) {
+  if ( ticket.value <= completedUploads ) return true;
+  collectUploads();
+  return ticket.value <= completedUploads;
+}
+
+void Device::waitForUpload( UploadTicket ticket ) {
+  while ( ticket.value > completedUploads ) {
+    assert( !pendingUploads.empty() && "Waiting for an unknown upload" );
+    vkWaitForFences(
+        device_, 1, &pendingUploads.front().fence, VK_TRUE, UINT64_MAX );
+    collectUploads();
+  }
+}
+
+void Device::collectUploads( bool wait ) {
+  uint64_t completed = 0;
+
+  while ( !pendingUploads.empty() ) {
+    PendingUpload &upload = pendingUploads.front();
+
+    if ( wait ) {
+      vkWaitForFences( device_, 1, &upload.fence, VK_TRUE, UINT64_MAX );
+    } else if ( vkGetFenceStatus( device_, upload.fence ) != VK_SUCCESS ) {
+      break;
+    }
+
+    vkFreeCommandBuffers(
+        device_, transferCommandPool, 1, &upload.commandBuffer );
+    if ( upload.acquireCommandBuffer != VK_NULL_HANDLE ) {
+      vkFreeCommandBuffers(
+          device_, commandPool, 1, &upload.acquireCommandBuffer );
+      freeUploadSemaphores.push_back( upload.semaphore );
+    }
+    vkResetFences( device_, 1, &upload.fence );
+    freeUploadFences.push_back( upload.fence );
+    completed = upload.submission;
+    pendingUploads.pop_front();
+  }
+
+  if ( completed > 0 ) {
+    completedUploads = completed;
+    stagingRing->release( completed );
+  }
 }
 
 void Device::createImageWithInfo(
     const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties,
-    VkImage &image, VkDeviceMemory &imageMemory ) {
+    VkImage &image, Allocation &imageAllocation ) {
   if ( vkCreateImage( device_, &imageInfo, nullptr, &image ) != VK_SUCCESS ) {
     throw std::runtime_error( "failed to create image!" );
   }
@@ -546,18 +985,13 @@ void Device::createImageWithInfo(
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements( device_, image, &memRequirements );
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex =
-      findMemoryType( memRequirements.memoryTypeBits, properties );
+  imageAllocation = allocator->allocate(
+      memRequirements, properties,
+      imageInfo.tiling == VK_IMAGE_TILING_LINEAR );
 
-  if ( vkAllocateMemory( device_, &allocInfo, nullptr, &imageMemory ) !=
+  if ( vkBindImageMemory(
+           device_, image, imageAllocation.memory, imageAllocation.offset ) !=
        VK_SUCCESS ) {
-    throw std::runtime_error( "failed to allocate image memory!" );
-  }
-
-  if ( vkBindImageMemory( device_, image, imageMemory, 0 ) != VK_SUCCESS ) {
     throw std::runtime_error( "failed to bind image memory!" );
   }
 }
@@ -1,13 +1,20 @@
 #pragma once
 
+#include "memory_allocator.hpp"
+#include "staging_ring.hpp"
 #include "window.hpp"
 
 // std lib headers
+#include <deque>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace lve {
 
+class GeometryPool;
+
 struct SwapChainSupportDetails {
   VkSurfaceCapabilitiesKHR capabilities;
   std::vector< VkSurfaceFormatKHR > formats;
@@ -17,35 +24,90 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  // a family that can do transfers but no graphics; these usually map to the
+  // GPU's copy engines, which run alongside rendering. Falls back to the
+  // graphics family if there is none.
+  uint32_t transferFamily;
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
+  bool transferFamilyHasValue = false;
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
+  bool hasDedicatedTransfer() {
+    return transferFamilyHasValue && transferFamily != graphicsFamily;
+  }
+};
+
+struct PipelineCacheStats {
+  // true if a valid cache for this device was loaded from disk
+  bool warm = false;
+  uint32_t pipelinesCreated = 0;
+  double creationMilliseconds = 0.0;
+  // later pipelines (e.g. after a swap chain rebuild) hit the in-memory
+  // cache either way, the first one shows the difference between runs
+  double firstCreationMilliseconds = 0.0;
+};
+
+// identifies an upload; it is complete once the device has finished it
+struct UploadTicket {
+  uint64_t value = 0;
 };
 
 class Device {
  public:
+  static constexpr VkDeviceSize STAGING_RING_SIZE = 16 * 1024 * 1024;
+  static constexpr const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
 #ifdef NDEBUG
   const bool enableValidationLayers = false;
 #else
   const bool enableValidationLayers = true;
 #endif
 
-  Device( Window& window );
+  // without a window (nullptr) the device runs headless: no surface and no
+  // swap chain extension, so it also works on machines without a display or
+  // with only a software driver such as lavapipe
+  explicit Device( Window* window );
+  Device( Window& window ) : Device( &window ) {}
   ~Device();
   Device( const Device& ) = delete;
   Device operator=( const Device& ) = delete;
 
   VkCommandPool getCommandPool() { return commandPool; }
   VkDevice device() { return device_; }
+  VkPhysicalDevice getPhysicalDevice() { return physicalDevice; }
   VkSurfaceKHR surface() { return surface_; }
+  bool isHeadless() { return window == nullptr; }
+  // VK_GOOGLE_display_timing, enabled when the device supports it; gives the
+  // actual time images were presented at
+  bool hasDisplayTiming() { return displayTimingEnabled; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
   VkQueue presentQueue() { return presentQueue_; }
+  VkQueue transferQueue() { return transferQueue_; }
+  VkPipelineCache pipelineCache() { return pipelineCache_; }
+  // the vertex and index buffer every model's geometry is in
+  GeometryPool& geometryPool() { return *geometryPool_; }
+  // whether a vkCmdDrawIndexedIndirect may have a drawCount above 1
+  bool hasMultiDrawIndirect() { return multiDrawIndirectEnabled; }
+  bool hasDrawIndirectFirstInstance() {
+    return drawIndirectFirstInstanceEnabled;
+  }
+
+  // pipelines report how long the driver took to build them, so we can see
+  // what the on-disk cache buys us
+  void recordPipelineCreation( double milliseconds ) {
+    if ( pipelineCacheStats.pipelinesCreated == 0 ) {
+      pipelineCacheStats.firstCreationMilliseconds = milliseconds;
+    }
+    pipelineCacheStats.pipelinesCreated++;
+    pipelineCacheStats.creationMilliseconds += milliseconds;
+  }
+  const PipelineCacheStats& getPipelineCacheStats() {
+    return pipelineCacheStats;
+  }
 
   SwapChainSupportDetails getSwapChainSupport() {
     return querySwapChainSupport( physicalDevice );
   }
-  uint32_t findMemoryType(
-      uint32_t typeFilter, VkMemoryPropertyFlags properties );
   QueueFamilyIndices findPhysicalQueueFamilies() {
     return findQueueFamilies( physicalDevice );
   }
@@ -57,17 +119,65 @@ class Device {
   void createBuffer(
       VkDeviceSize size, VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties, VkBuffer& buffer,
-      VkDeviceMemory& bufferMemory );
+      Allocation& bufferAllocation );
   VkCommandBuffer beginSingleTimeCommands();
   void endSingleTimeCommands( VkCommandBuffer commandBuffer );
-  void copyBuffer( VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size );
-  void copyBufferToImage(
-      VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
-      uint32_t layerCount );
+
+  // copies data into a (typically device local) buffer through the staging
+  // ring. The copy runs on the transfer queue and is not waited for; the
+  // returned ticket tells when the data is ready. Ownership of the buffer
+  // range is handed over to the graphics queue family, and draws submitted
+  // after the upload completes may read the buffer.
+  UploadTicket uploadToBuffer(
+      VkBuffer dstBuffer, const void* data, VkDeviceSize size,
+      VkDeviceSize dstOffset = 0 );
+  bool isUploadComplete( UploadTicket ticket );
+  void waitForUpload( UploadTicket ticket );
+  // releases staging space and command buffers of finished uploads. If wait
+  // is true, blocks until every upload submitted so far has completed
+  void collectUploads( bool wait = false );
+
+  // building blocks for UploadBatch; the staging region stays valid until
+  // the next submitUpload
+  bool tryAcquireStagingRegion(
+      VkDeviceSize size, VkDeviceSize alignment, StagingRegion& region );
+  StagingRegion acquireStagingRegion(
+      VkDeviceSize size, VkDeviceSize alignment );
+  VkDeviceSize stagingCapacity() { return stagingRing->capacity(); }
+  // batches that hold copies which haven't been submitted yet
+  void countUnflushedBatch( bool unflushed ) {
+    unflushed ? unflushedBatches++ : unflushedBatches--;
+  }
+  uint32_t getUnflushedBatchCount() const { return unflushedBatches; }
+  VkCommandBuffer beginTransferCommands();
+  // ends and submits a command buffer from beginTransferCommands. The
+  // barriers only need their buffer/image, range and layouts filled in; the
+  // rest (access masks and queue family ownership) is set up here
+  UploadTicket submitUpload(
+      VkCommandBuffer commandBuffer,
+      std::vector< VkBufferMemoryBarrier >& bufferBarriers,
+      std::vector< VkImageMemoryBarrier >& imageBarriers );
 
   void createImageWithInfo(
       const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties,
-      VkImage& image, VkDeviceMemory& imageMemory );
+      VkImage& image, Allocation& imageAllocation );
+
+  // returns a sub-allocation from createBuffer/createImageWithInfo to the
+  // allocator; the buffer or image bound to it must be destroyed first
+  void freeMemory( Allocation& allocation ) { allocator->free( allocation ); }
+  MemoryStats getMemoryStats() { return allocator->getStats(); }
+
+  // frames are numbered in submission order, starting at 1. Anything that a
+  // submitted frame might still use is handed to deferDestruction instead of
+  // being destroyed right away; it is destroyed once the frame that is
+  // current at that point has completed, without idling the device
+  uint64_t getCurrentFrameNumber() { return currentFrameNumber; }
+  // the current frame was submitted; returns its number
+  uint64_t endFrame() { return currentFrameNumber++; }
+  // the fence of this frame (and so of every earlier one) has signaled
+  void frameCompleted( uint64_t frameNumber );
+  void deferDestruction( std::function< void() > destroy );
+  size_t getDeferredDestructionCount() { return deferredDestructions.size(); }
 
   VkPhysicalDeviceProperties properties;
 
@@ -78,6 +188,11 @@ class Device {
   void pickPhysicalDevice();
   void createLogicalDevice();
   void createCommandPool();
+  void createStagingRing();
+  void createGeometryPool();
+  void createPipelineCache();
+  void savePipelineCache();
+  bool isPipelineCacheCompatible( const std::vector< char >& data );
 
   // helper functions
   bool isDeviceSuitable( VkPhysicalDevice device );
@@ -93,20 +208,63 @@ class Device {
   VkInstance instance;
   VkDebugUtilsMessengerEXT debugMessenger;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-  Window& window;
+  Window* window;
   VkCommandPool commandPool;
 
   VkDevice device_;
-  VkSurfaceKHR surface_;
+  VkSurfaceKHR surface_ = VK_NULL_HANDLE;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
+  VkQueue transferQueue_;
+  VkCommandPool transferCommandPool;
+  QueueFamilyIndices queueFamilyIndices;
+  VkPipelineCache pipelineCache_;
+  PipelineCacheStats pipelineCacheStats;
+
+  std::unique_ptr< MemoryAllocator > allocator;
+
+  struct PendingUpload {
+    uint64_t submission;
+    VkFence fence;
+    VkCommandBuffer commandBuffer;
+    // only used when uploading on a dedicated transfer queue
+    VkCommandBuffer acquireCommandBuffer;
+    VkSemaphore semaphore;
+  };
+
+  VkBuffer stagingBuffer;
+  Allocation stagingAllocation;
+  std::unique_ptr< StagingRing > stagingRing;
+  std::unique_ptr< GeometryPool > geometryPool_;
+  std::deque< PendingUpload > pendingUploads;
+  std::vector< VkFence > freeUploadFences;
+  std::vector< VkSemaphore > freeUploadSemaphores;
+  uint64_t submittedUploads = 0;
+  uint64_t completedUploads = 0;
+  uint32_t unflushedBatches = 0;
+
+  VkFence getUploadFence();
+  VkSemaphore getUploadSemaphore();
+
+  struct DeferredDestruction {
+    uint64_t frameNumber;
+    std::function< void() > destroy;
+  };
+
+  uint64_t currentFrameNumber = 1;
+  uint64_t completedFrameNumber = 0;
+  std::deque< DeferredDestruction > deferredDestructions;
 
   const std::vector< const char* > validationLayers = {
     "VK_LAYER_KHRONOS_validation"
   };
-  const std::vector< const char* > deviceExtensions = {
+  // cleared when running headless
+  std::vector< const char* > deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
   };
+  bool displayTimingEnabled = false;
+  bool multiDrawIndirectEnabled = false;
+  bool drawIndirectFirstInstanceEnabled = false;
 };
 
 }  // namespace lve
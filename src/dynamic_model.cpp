@@ -0,0 +1,113 @@
+#include "dynamic_model.hpp"
+
+// std headers
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace lve {
+
+DynamicModel::DynamicModel( Device& _device, uint32_t framesInFlight )
+    : device{ _device }, slots( framesInFlight ) {
+  createRing( INITIAL_VERTEX_CAPACITY, INITIAL_INDEX_CAPACITY );
+}
+
+DynamicModel::~DynamicModel() { retireRing(); }
+
+void DynamicModel::createRing( uint32_t vertices, uint32_t indices ) {
+  retireRing();
+  vertexCapacity = vertices;
+  indexCapacity = indices;
+  capacity = slots.size() * regionSize();
+
+  // coherent, so the writes need no flush; they are visible to the frame
+  // once it is submitted
+  device.createBuffer(
+      capacity,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      buffer, allocation );
+  assert( allocation.mapped != nullptr && "Dynamic model isn't mapped" );
+
+  // the regions that are drawn next are written first, nothing to keep
+  for ( auto& slot: slots ) slot = Slot{};
+}
+
+void DynamicModel::retireRing() {
+  if ( buffer == VK_NULL_HANDLE ) return;
+
+  // frames in flight may still be drawing from their regions
+  Device& owner = device;
+  VkBuffer oldBuffer = buffer;
+  Allocation oldAllocation = allocation;
+  device.deferDestruction( [&owner, oldBuffer, oldAllocation]() mutable {
+    vkDestroyBuffer( owner.device(), oldBuffer, nullptr );
+    owner.freeMemory( oldAllocation );
+  } );
+
+  buffer = VK_NULL_HANDLE;
+  allocation = Allocation{};
+}
+
+void DynamicModel::resize(
+    uint32_t frameIndex, uint32_t vertexCount, uint32_t indexCount ) {
+  if ( vertexCount > vertexCapacity || indexCount > indexCapacity ) {
+    // geometric growth, so that geometry that grows a little every frame
+    // doesn't replace the ring every frame
+    createRing(
+        std::max( vertexCount, vertexCapacity * 2 ),
+        std::max( indexCount, indexCapacity * 2 ) );
+  }
+
+  slots[frameIndex].vertexCount = vertexCount;
+  slots[frameIndex].indexCount = indexCount;
+}
+
+Model::Vertex* DynamicModel::getVertices( uint32_t frameIndex ) {
+  auto* base = static_cast< char* >( allocation.mapped );
+  return reinterpret_cast< Model::Vertex* >(
+      base + vertexOffset( frameIndex ) );
+}
+
+uint32_t* DynamicModel::getIndices( uint32_t frameIndex ) {
+  auto* base = static_cast< char* >( allocation.mapped );
+  return reinterpret_cast< uint32_t* >( base + indexOffset( frameIndex ) );
+}
+
+void DynamicModel::update(
+    uint32_t frameIndex, const Model::Builder& builder ) {
+  resize(
+      frameIndex, static_cast< uint32_t >( builder.vertices.size() ),
+      static_cast< uint32_t >( builder.indices.size() ) );
+  std::memcpy(
+      getVertices( frameIndex ), builder.vertices.data(),
+      builder.vertices.size() * sizeof( Model::Vertex ) );
+  std::memcpy(
+      getIndices( frameIndex ), builder.indices.data(),
+      builder.indices.size() * sizeof( uint32_t ) );
+}
+
+VkDeviceSize DynamicModel::getBytes( uint32_t frameIndex ) const {
+  const Slot& slot = slots[frameIndex];
+  return slot.vertexCount * sizeof( Model::Vertex ) +
+         slot.indexCount * sizeof( uint32_t );
+}
+
+void DynamicModel::bind( VkCommandBuffer commandBuffer, uint32_t frameIndex ) {
+  VkDeviceSize offset = vertexOffset( frameIndex );
+  vkCmdBindVertexBuffers( commandBuffer, 0, 1, &buffer, &offset );
+  vkCmdBindIndexBuffer(
+      commandBuffer, buffer, indexOffset( frameIndex ), VK_INDEX_TYPE_UINT32 );
+}
+
+void DynamicModel::draw(
+    VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t instanceCount,
+    uint32_t firstInstance ) {
+  const Slot& slot = slots[frameIndex];
+  if ( slot.indexCount == 0 ) return;
+  vkCmdDrawIndexed(
+      commandBuffer, slot.indexCount, instanceCount, 0, 0, firstInstance );
+}
+
+}  // namespace lve
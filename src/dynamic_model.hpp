@@ -0,0 +1,89 @@
+#pragma once
+
+#include "device.hpp"
+#include "model.hpp"
+
+// std lib headers
+#include <vector>
+
+namespace lve {
+
+// geometry that changes every frame, e.g. procedural shapes or debug
+// drawing, without creating buffers or mapping memory per frame. One host
+// visible buffer stays mapped for the model's lifetime and is split into a
+// region per frame in flight; the frame in slot i writes and draws region i.
+// A slot is only reused once the fence of the frame that last used it was
+// waited for, so writing the current slot never races the GPU reading the
+// regions of the frames still in flight.
+//
+// Vertices are always Model::Vertex and indices 32 bit. A region keeps what
+// was written to it until it grows, so a frame that draws the model has to
+// write it first
+class DynamicModel {
+ public:
+  static constexpr uint32_t INITIAL_VERTEX_CAPACITY = 4096;
+  static constexpr uint32_t INITIAL_INDEX_CAPACITY = 4096;
+
+  DynamicModel( Device&, uint32_t framesInFlight );
+  ~DynamicModel();
+  DynamicModel( const DynamicModel& ) = delete;
+  DynamicModel& operator=( const DynamicModel& ) = delete;
+
+  // sets the slot's counts, growing the regions if needed. The pointers
+  // below are valid until the next resize of any slot
+  void resize(
+      uint32_t frameIndex, uint32_t vertexCount, uint32_t indexCount );
+  // straight into mapped memory, for writing the geometry in place
+  Model::Vertex* getVertices( uint32_t frameIndex );
+  uint32_t* getIndices( uint32_t frameIndex );
+  // resize and copy; the builder's format is ignored
+  void update( uint32_t frameIndex, const Model::Builder& builder );
+
+  void bind( VkCommandBuffer, uint32_t frameIndex );
+  void draw(
+      VkCommandBuffer, uint32_t frameIndex, uint32_t instanceCount = 1,
+      uint32_t firstInstance = 0 );
+
+  uint32_t getVertexCount( uint32_t frameIndex ) const {
+    return slots[frameIndex].vertexCount;
+  }
+  uint32_t getIndexCount( uint32_t frameIndex ) const {
+    return slots[frameIndex].indexCount;
+  }
+  // what the slot's geometry takes up, e.g. to count it as uploaded
+  VkDeviceSize getBytes( uint32_t frameIndex ) const;
+  // whole ring, over all slots
+  VkDeviceSize getCapacity() const { return capacity; }
+
+ private:
+  struct Slot {
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+  };
+
+  Device& device;
+  std::vector< Slot > slots;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  Allocation allocation;
+  VkDeviceSize capacity = 0;
+  // per region; indices start right after the vertices
+  uint32_t vertexCapacity = 0;
+  uint32_t indexCapacity = 0;
+
+  VkDeviceSize regionSize() const {
+    return vertexCapacity * sizeof( Model::Vertex ) +
+           indexCapacity * sizeof( uint32_t );
+  }
+  VkDeviceSize vertexOffset( uint32_t frameIndex ) const {
+    return frameIndex * regionSize();
+  }
+  VkDeviceSize indexOffset( uint32_t frameIndex ) const {
+    return vertexOffset( frameIndex ) +
+           vertexCapacity * sizeof( Model::Vertex );
+  }
+  // replaces the ring with one whose regions hold this much
+  void createRing( uint32_t vertices, uint32_t indices );
+  void retireRing();
+};
+
+}  // namespace lve
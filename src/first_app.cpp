@@ -1,57 +1,402 @@
 #include "first_app.hpp"
 
+#include "mesh_file.hpp"
+
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
+#include <iostream>
+#include <random>
 #include <set>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include <sys/resource.h>
 
-struct SimplePushConstantData {
-  glm::mat2 transform{ 1.f };
+// one object of the per object path, laid out as std430 for the storage
+// buffer in simple_shader.vert
+struct ObjectData {
+  // columns of the 2x2 transform
+  glm::vec4 transform;
   glm::vec2 offset;
-  alignas( 16 ) glm::vec3 color;
+  glm::vec2 padding;
+  glm::vec4 color;
 };
 
 namespace lve {
 
 void FirstApp::run() {
-  while ( !window.shouldClose() ) {
-    glfwPollEvents();
-    drawFrame();
-    vkDeviceWaitIdle( device.device() );
+  using clock = std::chrono::steady_clock;
+
+  // frame times over the whole run; the rolling window only keeps the end
+  RollingStats frameTimes{ config.frameCount > 0 ? config.frameCount : 1000 };
+  uint32_t frame = 0;
+  auto start = clock::now();
+  auto previous = start;
+
+  // the simulation advances in fixed steps of real time, independent of how
+  // fast frames are drawn; whatever is left over between steps is used to
+  // blend the last two states when drawing
+  for ( auto& object: gameObjects )
+    object.previousTransform2d = object.transform2d;
+  double accumulator = 0.0;
+
+  for ( ; config.frameCount == 0 || frame < config.frameCount; frame++ ) {
+    if ( window != nullptr ) {
+      if ( window->shouldClose() ) break;
+      glfwPollEvents();
+      handleKeyPresses();
+    }
+
+    while ( accumulator >= SIMULATION_STEP ) {
+      updateGameObjects( SIMULATION_STEP );
+      accumulator -= SIMULATION_STEP;
+    }
+    if ( modelLoader != nullptr ) updateModelLoader();
+    drawFrame( static_cast< float >( accumulator / SIMULATION_STEP ) );
+    if ( frame == 0 ) {
+      firstFrameMilliseconds =
+          std::chrono::duration< double, std::milli >(
+              clock::now() - createdAt )
+              .count();
+      std::cout << "first frame after " << firstFrameMilliseconds << " ms"
+                << std::endl;
+    }
+
+    // the old fully serialized loop, kept to compare against
+    if ( config.waitIdleEachFrame ) vkDeviceWaitIdle( device.device() );
+
+    auto now = clock::now();
+    double elapsed = std::chrono::duration< double >( now - previous ).count();
+    frameTimes.add( elapsed * 1000.0 );
+    recordPresentStats( elapsed * 1000.0 );
+    previous = now;
+
+    // after a hitch, e.g. dragging the window, don't try to catch up on
+    // seconds of simulation at once
+    accumulator += config.fixedSimulationSteps
+                       ? SIMULATION_STEP
+                       : std::min( elapsed, MAX_FRAME_TIME );
+  }
+
+  // the last frames are still in flight; nothing may be destroyed before
+  // they are done
+  vkDeviceWaitIdle( device.device() );
+
+  double seconds =
+      std::chrono::duration< double >( clock::now() - start ).count();
+  if ( frame > 0 && seconds > 0.0 ) {
+    std::cout << frame << " frames in " << seconds << " s: "
+              << frame / seconds << " fps, frame time avg "
+              << frameTimes.average() << " ms, p99 "
+              << frameTimes.percentile( 99.0 ) << " ms"
+              << ( config.waitIdleEachFrame ? " (idle after every frame)"
+                                            : "" )
+              << std::endl;
+  }
+
+  printPresentStats();
+  if ( !config.reportPath.empty() )
+    writeReport( config.reportPath, frame, seconds, frameTimes );
+
+  if ( config.renderMode == RenderMode::PerObject ) {
+    const RenderQueueStats& stats = renderQueue.getStats();
+    std::cout << "binds: " << stats.pipelineBinds << " pipeline ("
+              << stats.pipelineBindsSkipped << " skipped), "
+              << stats.geometryBinds << " geometry ("
+              << stats.geometryBindsSkipped << " skipped)" << std::endl;
+  }
+
+  for ( const auto& stats: telemetry.summarize() ) {
+    // the counters are in the exported files
+    if ( std::strstr( stats.name, "_ms" ) == nullptr ) continue;
+    std::cout << "cpu " << stats.name << ": p50 " << stats.p50 << ", p99 "
+              << stats.p99 << ", max " << stats.max << std::endl;
+  }
+
+  if ( indirectRenderer != nullptr ) {
+    std::cout << "gpu culling: " << indirectRenderer->getVisibleCount()
+              << " visible, " << indirectRenderer->getCulledCount()
+              << " culled" << std::endl;
   }
 }
 
-FirstApp::FirstApp() {
+void FirstApp::handleKeyPresses() {
+  static constexpr VkPresentModeKHR presentModes[] = {
+    VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+    VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+  static constexpr size_t presentModeCount =
+      sizeof( presentModes ) / sizeof( presentModes[0] );
+
+  SwapChainSettings& settings = config.swapChainSettings;
+  bool changed = false;
+  for ( int key: window->takeKeyPresses() ) {
+    if ( key == GLFW_KEY_P ) {
+      // cycle on from the mode actually in use, the requested one may not
+      // be supported
+      size_t current = 0;
+      while ( current < presentModeCount &&
+              presentModes[current] != swapChain->getPresentMode() )
+        current++;
+      settings.presentMode =
+          presentModes[( current + 1 ) % presentModeCount];
+      changed = true;
+    } else if ( key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD ) {
+      settings.imageCount =
+          static_cast< uint32_t >( swapChain->imageCount() ) + 1;
+      changed = true;
+    } else if ( key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT ) {
+      // the surface's minimum is enforced by the swap chain
+      settings.imageCount = std::max(
+          static_cast< uint32_t >( swapChain->imageCount() ), 2u ) - 1;
+      changed = true;
+    } else if ( key == GLFW_KEY_T ) {
+      writeTelemetry();
+    }
+  }
+
+  if ( !changed ) return;
+  recreateSwapChain();
+  std::cout << "swap chain: " << SwapChain::presentModeName(
+                                     swapChain->getPresentMode() )
+            << ", " << swapChain->imageCount() << " images" << std::endl;
+}
+
+void FirstApp::recordPresentStats( double frameTime ) {
+  PresentStats& stats = presentStats[{ swapChain->getPresentMode(),
+                                       swapChain->imageCount() }];
+  stats.frameTimes.add( frameTime );
+
+  latencySamples.clear();
+  swapChain->takeLatencySamples( latencySamples );
+  for ( double latency: latencySamples ) stats.latencies.add( latency );
+}
+
+// the most memory the process ever had resident, in bytes
+static uint64_t peakResidentBytes() {
+  rusage usage{};
+  if ( getrusage( RUSAGE_SELF, &usage ) != 0 ) return 0;
+#ifdef __APPLE__
+  return static_cast< uint64_t >( usage.ru_maxrss );
+#else
+  // kilobytes everywhere else
+  return static_cast< uint64_t >( usage.ru_maxrss ) * 1024;
+#endif
+}
+
+void FirstApp::writeReport(
+    const std::string& path, uint32_t frames, double seconds,
+    const RollingStats& frameTimes ) {
+  std::ofstream file{ path, std::ios::trunc };
+  if ( !file ) {
+    std::cerr << "failed to write " << path << std::endl;
+    return;
+  }
+
+  const char* modes[] = { "per-object", "instanced", "indirect" };
+  uint64_t indexCount = 0;
+  for ( const auto& object: gameObjects )
+    indexCount += object.model->getIndexCount();
+
+  TelemetryFieldStats record{ "record_ms" };
+  for ( const auto& stats: telemetry.summarize() )
+    if ( std::strcmp( stats.name, "record_ms" ) == 0 ) record = stats;
+
+  // timestamps are not supported everywhere, e.g. by some software drivers
+  ProfilerScopeStats gpuFrame{};
+  bool hasGpuTime = profiler.getStats( "frame", gpuFrame );
+
+  MemoryStats memory = device.getMemoryStats();
+  Model::GeometryStats geometry = getGeometryStats();
+
+  file << "{\n";
+  file << "  \"render_mode\": \""
+       << modes[static_cast< int >( config.renderMode )] << "\",\n";
+  file << "  \"objects\": " << gameObjects.size() << ",\n";
+  if ( config.useBenchmarkScene ) {
+    const BenchmarkScene& scene = config.benchmarkScene;
+    file << "  \"models\": " << scene.modelCount << ",\n";
+    file << "  \"unique_models\": " << scene.uniqueModelCount << ",\n";
+    file << "  \"sierpinski_depth\": " << scene.sierpinskiDepth << ",\n";
+    file << "  \"seed\": " << scene.seed << ",\n";
+  }
+  file << "  \"indices_drawn_per_frame\": " << indexCount << ",\n";
+  file << "  \"wait_idle_each_frame\": "
+       << ( config.waitIdleEachFrame ? "true" : "false" ) << ",\n";
+  file << "  \"frames\": " << frames << ",\n";
+  file << "  \"seconds\": " << seconds << ",\n";
+  file << "  \"fps\": " << ( seconds > 0.0 ? frames / seconds : 0.0 )
+       << ",\n";
+  file << "  \"frame_ms\": { \"avg\": " << frameTimes.average()
+       << ", \"p50\": " << frameTimes.percentile( 50.0 )
+       << ", \"p99\": " << frameTimes.percentile( 99.0 ) << " },\n";
+  file << "  \"cpu_record_ms\": { \"avg\": " << record.avg
+       << ", \"p50\": " << record.p50 << ", \"p99\": " << record.p99
+       << " },\n";
+  if ( hasGpuTime ) {
+    file << "  \"gpu_frame_ms\": { \"avg\": " << gpuFrame.avgMilliseconds
+         << ", \"p99\": " << gpuFrame.p99Milliseconds << " },\n";
+  } else {
+    file << "  \"gpu_frame_ms\": null,\n";
+  }
+  file << "  \"geometry_bytes\": " << geometry.bytes << ",\n";
+  file << "  \"geometry_unindexed_bytes\": " << geometry.unindexedBytes
+       << ",\n";
+  file << "  \"acmr\": " << geometry.acmr << ",\n";
+  file << "  \"vertex_format\": \"" << vertexFormatName( config.vertexFormat )
+       << "\",\n";
+  file << "  \"vertex_stride\": " << geometry.vertexStride << ",\n";
+  file << "  \"max_position_error\": " << geometry.maxPositionError << ",\n";
+  file << "  \"position_error_bound\": " << geometry.positionErrorBound
+       << ",\n";
+  file << "  \"max_color_error\": " << geometry.maxColorError << ",\n";
+  const ModelRegistryStats& registry = modelRegistry.getStats();
+  file << "  \"registry_hit_rate\": " << registry.hitRate() << ",\n";
+  file << "  \"registry_bytes_saved\": " << registry.bytesSaved << ",\n";
+  GeometryPoolStats pool = device.geometryPool().getStats();
+  file << "  \"geometry_pool_bytes\": " << pool.vertexBytes + pool.indexBytes
+       << ",\n";
+  file << "  \"geometry_pool_capacity\": "
+       << pool.vertexCapacity + pool.indexCapacity << ",\n";
+  file << "  \"geometry_pool_relocations\": " << pool.relocations << ",\n";
+  file << "  \"mesh_files\": " << config.meshPaths.size() << ",\n";
+  file << "  \"mesh_load_ms\": " << meshLoadMilliseconds << ",\n";
+  file << "  \"dynamic_geometry\": "
+       << ( config.dynamicGeometry ? "true" : "false" ) << ",\n";
+  file << "  \"streamed_models\": "
+       << ( config.streamModels ? "true" : "false" ) << ",\n";
+  file << "  \"first_frame_ms\": " << firstFrameMilliseconds << ",\n";
+  file << "  \"models_resident_ms\": " << modelsResidentMilliseconds << ",\n";
+  file << "  \"gpu_memory_reserved_bytes\": " << memory.reservedBytes
+       << ",\n";
+  file << "  \"gpu_memory_used_bytes\": " << memory.usedBytes << ",\n";
+  file << "  \"peak_rss_bytes\": " << peakResidentBytes() << "\n";
+  file << "}\n";
+
+  std::cout << "wrote " << path << std::endl;
+}
+
+void FirstApp::writeTelemetry() {
+  if ( telemetry.writeCsv( "frame_telemetry.csv" ) &&
+       telemetry.writeJson( "frame_telemetry.json" ) ) {
+    std::cout << "wrote frame_telemetry.csv and frame_telemetry.json"
+              << std::endl;
+  }
+}
+
+void FirstApp::printPresentStats() {
+  const char* latencyKind = swapChain->measuresPresentTime()
+                                ? "submit to present"
+                                : "submit to frame done";
+  for ( const auto& entry: presentStats ) {
+    const PresentStats& stats = entry.second;
+    std::cout << SwapChain::presentModeName( entry.first.first ) << ", "
+              << entry.first.second
+              << " images: " << stats.frameTimes.totalCount()
+              << " frames, frame time avg " << stats.frameTimes.average()
+              << " ms, stddev " << std::sqrt( stats.frameTimes.variance() )
+              << " ms";
+    if ( stats.latencies.count() > 0 ) {
+      std::cout << ", " << latencyKind << " avg "
+                << stats.latencies.average() << " ms, p99 "
+                << stats.latencies.percentile( 99.0 ) << " ms";
+    }
+    std::cout << std::endl;
+  }
+}
+
+FirstApp::FirstApp( AppConfig _config )
+    : config{ _config },
+      window{
+          config.headless
+              ? nullptr
+              : std::make_unique< Window >( width, height, "Hello Vulkan!" ) } {
+  if ( config.renderMode == RenderMode::Indirect ) {
+    indirectRenderer = std::make_unique< IndirectRenderer >(
+        device, SwapChain::MAX_FRAMES_IN_FLIGHT );
+  }
+
+  if ( config.dynamicGeometry ) {
+    dynamicModel = std::make_unique< DynamicModel >(
+        device, SwapChain::MAX_FRAMES_IN_FLIGHT );
+  }
+
+  if ( config.streamModels ) {
+    // streamed models are deduplicated like the others, once loaded
+    modelLoader = std::make_unique< ModelLoader >( device, &modelRegistry );
+    std::vector< Model::Vertex > vertices{
+      { { 0.f, -0.5f }, { 0.5f, 0.5f, 0.5f } },
+      { { 0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f } },
+      { { -0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f } } };
+    placeholderModel = std::make_shared< Model >( device, vertices );
+  }
+
   loadGameObjects();
+  if ( modelLoader == nullptr ) {
+    compactGeometry();
+    modelsResidentMilliseconds =
+        std::chrono::duration< double, std::milli >(
+            std::chrono::steady_clock::now() - createdAt )
+            .count();
+  }
   createPipelineLayout();
+  createDescriptorSets();
   recreateSwapChain();
   createCommandBuffers();
 }
 
 FirstApp::~FirstApp() {
+  for ( const auto& stats: profiler.getStats() ) {
+    std::cout << "gpu " << stats.name << ": min " << stats.minMilliseconds
+              << " ms, avg " << stats.avgMilliseconds << " ms, p99 "
+              << stats.p99Milliseconds << " ms" << std::endl;
+  }
+  profiler.writeCsv( "gpu_timings.csv" );
+  writeTelemetry();
+
   vkDestroyPipelineLayout( device.device(), pipelineLayout, nullptr );
+  vkDestroyDescriptorPool( device.device(), descriptorPool, nullptr );
+  vkDestroyDescriptorSetLayout( device.device(), objectSetLayout, nullptr );
 }
 
 void FirstApp::createPipelineLayout() {
-  VkPushConstantRange pushConstantRange{};
-  pushConstantRange.stageFlags =
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-  pushConstantRange.offset = 0;
-  pushConstantRange.size = sizeof( SimplePushConstantData );
+  // the object data of the per object path; shaders that don't use it
+  // simply leave the set alone
+  VkDescriptorSetLayoutBinding objectBinding{};
+  objectBinding.binding = 0;
+  objectBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  objectBinding.descriptorCount = 1;
+  objectBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 1;
+  layoutInfo.pBindings = &objectBinding;
+
+  if ( vkCreateDescriptorSetLayout(
+           device.device(), &layoutInfo, nullptr, &objectSetLayout ) !=
+       VK_SUCCESS )
+    throw std::runtime_error( "Failed to create descriptor set layout" );
 
   VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 0;
 
   // set layouts are used to push information other than vertices to shaders
-  pipelineLayoutInfo.pSetLayouts = nullptr;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &objectSetLayout;
 
-  // push constants are a way to send limited data to shader programs
-  pipelineLayoutInfo.pushConstantRangeCount = 1;
-  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+  // per object data used to be pushed as constants, which costs a command
+  // per draw and is limited to 128 bytes; it lives in a storage buffer now
+  pipelineLayoutInfo.pushConstantRangeCount = 0;
+  pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
   if ( vkCreatePipelineLayout(
            device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout ) !=
@@ -59,6 +404,56 @@ void FirstApp::createPipelineLayout() {
     throw std::runtime_error( "Failed to create pipeline layout" );
 }
 
+void FirstApp::createDescriptorSets() {
+  const uint32_t framesInFlight = SwapChain::MAX_FRAMES_IN_FLIGHT;
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = framesInFlight;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  poolInfo.maxSets = framesInFlight;
+
+  if ( vkCreateDescriptorPool(
+           device.device(), &poolInfo, nullptr, &descriptorPool ) !=
+       VK_SUCCESS )
+    throw std::runtime_error( "Failed to create descriptor pool" );
+
+  std::vector< VkDescriptorSetLayout > layouts(
+      framesInFlight, objectSetLayout );
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = framesInFlight;
+  allocInfo.pSetLayouts = layouts.data();
+
+  objectDescriptorSets.resize( framesInFlight );
+  if ( vkAllocateDescriptorSets(
+           device.device(), &allocInfo, objectDescriptorSets.data() ) !=
+       VK_SUCCESS )
+    throw std::runtime_error( "Failed to allocate descriptor sets" );
+}
+
+void FirstApp::updateObjectDescriptorSet( uint32_t frameIndex ) {
+  VkDescriptorBufferInfo bufferInfo{};
+  bufferInfo.buffer = objectBuffer.getBuffer( frameIndex );
+  bufferInfo.offset = 0;
+  bufferInfo.range = VK_WHOLE_SIZE;
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = objectDescriptorSets[frameIndex];
+  write.dstBinding = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pBufferInfo = &bufferInfo;
+
+  vkUpdateDescriptorSets( device.device(), 1, &write, 0, nullptr );
+}
+
 void FirstApp::createPipeline() {
   assert(
       swapChain != nullptr && "Cannot create pipeline before swap chain! " );
@@ -71,48 +466,68 @@ void FirstApp::createPipeline() {
   pipelineConfig.renderPass = swapChain->getRenderPass();
   pipelineConfig.pipelineLayout = pipelineLayout;
 
-  pipeline = std::make_unique< Pipeline >(
-      device, "assets/shaders/simple_shader.vert.spv",
-      "assets/shaders/simple_shader.frag.spv", pipelineConfig );
+  for ( uint32_t i = 0; i < VERTEX_FORMAT_COUNT; i++ ) {
+    VertexFormat format = static_cast< VertexFormat >( i );
+    pipelineConfig.bindingDescriptions =
+        Model::Vertex::getBindingDescriptions( false, format );
+    pipelineConfig.attributeDescriptions =
+        Model::Vertex::getAttributeDescriptions( false, format );
+    pipelines[i] = std::make_unique< Pipeline >(
+        device, "assets/shaders/simple_shader.vert.spv",
+        "assets/shaders/simple_shader.frag.spv", pipelineConfig );
+
+    // same state, plus the per instance vertex binding
+    pipelineConfig.bindingDescriptions =
+        Model::Vertex::getBindingDescriptions( true, format );
+    pipelineConfig.attributeDescriptions =
+        Model::Vertex::getAttributeDescriptions( true, format );
+    instancedPipelines[i] = std::make_unique< Pipeline >(
+        device, "assets/shaders/simple_shader_instanced.vert.spv",
+        "assets/shaders/simple_shader.frag.spv", pipelineConfig );
+  }
+}
+
+VkExtent2D FirstApp::getExtent() {
+  if ( window == nullptr ) {
+    return { static_cast< uint32_t >( width ),
+             static_cast< uint32_t >( height ) };
+  }
+  return window->getExtent();
 }
 
 void FirstApp::recreateSwapChain() {
-  auto extent = window.getExtent();
+  auto extent = getExtent();
 
+  // a minimized window has no size; wait until it comes back
   while ( extent.width == 0 || extent.height == 0 ) {
-    extent = window.getExtent();
+    extent = getExtent();
     glfwWaitEvents();
   }
 
-  vkDeviceWaitIdle( device.device() );
-
+  // no vkDeviceWaitIdle: frames still in flight keep using the old swap
+  // chain, which is only destroyed once they are done
   if ( swapChain == nullptr ) {
-    swapChain = std::make_unique< SwapChain >( device, extent );
-  } else {
-    swapChain =
-        std::make_unique< SwapChain >( device, extent, std::move( swapChain ) );
-    if ( swapChain->imageCount() != commandBuffers.size() ) {
-      freeCommandBuffers();
-      createCommandBuffers();
-    }
+    swapChain = std::make_unique< SwapChain >(
+        device, extent, config.swapChainSettings );
+    createPipeline();
+    return;
   }
 
+  std::shared_ptr< SwapChain > oldSwapChain = std::move( swapChain );
+  swapChain = std::make_unique< SwapChain >(
+      device, extent, oldSwapChain, config.swapChainSettings );
+
   // check if renderpasses are compatible; if they are, we don't need to
   // recreate the pipeline
-  createPipeline();
-}
-
-void FirstApp::freeCommandBuffers() {
-  vkFreeCommandBuffers(
-      device.device(), device.getCommandPool(),
-      static_cast< float >( commandBuffers.size() ), commandBuffers.data() );
-  commandBuffers.clear();
+  if ( !oldSwapChain->compareSwapFormats( *swapChain ) ) createPipeline();
 }
 
 void FirstApp::createCommandBuffers() {
-  // resize the commandBuffers vector to have as many as we have framebuffers
-  // (most probably 2 or 3)
-  commandBuffers.resize( swapChain->imageCount() );
+  // one command buffer per frame in flight: while the GPU works through one
+  // frame the CPU records the next into another buffer. A buffer is only
+  // re-recorded once acquireNextImage has waited for the fence of the frame
+  // that last used it
+  commandBuffers.resize( SwapChain::MAX_FRAMES_IN_FLIGHT );
 
   VkCommandBufferAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -133,14 +548,33 @@ void FirstApp::createCommandBuffers() {
     throw std::runtime_error( "failed to initialize commandbuffers" );
 }
 
-void FirstApp::recordCommandBuffer( int imageIndex ) {
+void FirstApp::recordCommandBuffer( int imageIndex, float alpha ) {
+  VkCommandBuffer commandBuffer = commandBuffers[swapChain->getCurrentFrame()];
+
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  if ( vkBeginCommandBuffer( commandBuffers[imageIndex], &beginInfo ) !=
-       VK_SUCCESS )
+  if ( vkBeginCommandBuffer( commandBuffer, &beginInfo ) != VK_SUCCESS )
     throw std::runtime_error( "command buffer failed to begin recording" );
 
+  // queries are reset here, outside of the render pass
+  profiler.beginFrame(
+      commandBuffer, static_cast< uint32_t >( swapChain->getCurrentFrame() ) );
+  uint32_t frameScope = profiler.beginScope( commandBuffer, "frame" );
+
+  if ( config.renderMode != RenderMode::PerObject ) groupObjectsByModel();
+
+  // culling writes the draw commands, so it has to happen before the render
+  // pass starts
+  if ( config.renderMode == RenderMode::Indirect ) {
+    Profiler::Scope scope{ profiler, commandBuffer, "cull" };
+    indirectRenderer->cull(
+        commandBuffer, static_cast< uint32_t >( swapChain->getCurrentFrame() ),
+        gameObjects, objectBatches, batches, alpha );
+    frameTelemetry.uploadBytes += indirectRenderer->getUploadedBytes();
+  }
+
   VkRenderPassBeginInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassInfo.renderPass = swapChain->getRenderPass();
@@ -155,12 +589,15 @@ void FirstApp::recordCommandBuffer( int imageIndex ) {
       static_cast< uint32_t >( clearValues.size() );
   renderPassInfo.pClearValues = clearValues.data();
 
+  uint32_t renderPassScope =
+      profiler.beginScope( commandBuffer, "render pass" );
+
   // VK_SUBPASS_CONTENTS_INLINE somehow signals that no secondary command
   // buffers will be used for secondary commands. The alternative is
   // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS that signifies use of
   // secondary command buffers to execute secondary commands
   vkCmdBeginRenderPass(
-      commandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
+      commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
 
   VkViewport viewport{};
   viewport.x = 0.f;
@@ -172,42 +609,265 @@ void FirstApp::recordCommandBuffer( int imageIndex ) {
   viewport.minDepth = 0.f;
   viewport.maxDepth = 1.f;
   VkRect2D scissor{ { 0, 0 }, swapChain->getSwapChainExtent() };
-  vkCmdSetViewport( commandBuffers[imageIndex], 0, 1, &viewport );
-  vkCmdSetScissor( commandBuffers[imageIndex], 0, 1, &scissor );
+  vkCmdSetViewport( commandBuffer, 0, 1, &viewport );
+  vkCmdSetScissor( commandBuffer, 0, 1, &scissor );
 
-  renderGameObjects( commandBuffers[imageIndex] );
+  renderGameObjects( commandBuffer, alpha );
+  if ( dynamicModel != nullptr ) renderDynamicGeometry( commandBuffer, alpha );
 
-  vkCmdEndRenderPass( commandBuffers[imageIndex] );
+  vkCmdEndRenderPass( commandBuffer );
+  profiler.endScope( commandBuffer, renderPassScope );
+  profiler.endScope( commandBuffer, frameScope );
 
-  if ( vkEndCommandBuffer( commandBuffers[imageIndex] ) != VK_SUCCESS )
+  if ( vkEndCommandBuffer( commandBuffer ) != VK_SUCCESS )
     throw std::runtime_error( "failed to record command buffer" );
 }
 
-void FirstApp::renderGameObjects( VkCommandBuffer commandBuffer ) {
-  pipeline->bind( commandBuffer );
+void FirstApp::renderGameObjects(
+    VkCommandBuffer commandBuffer, float alpha ) {
+  if ( config.renderMode == RenderMode::Instanced ) {
+    renderGameObjectsInstanced( commandBuffer, alpha );
+    return;
+  }
+
+  if ( config.renderMode == RenderMode::Indirect ) {
+    std::vector< Pipeline* > formatPipelines;
+    for ( auto& instancedPipeline: instancedPipelines )
+      formatPipelines.push_back( instancedPipeline.get() );
+
+    uint32_t frameIndex =
+        static_cast< uint32_t >( swapChain->getCurrentFrame() );
+    Profiler::Scope scope{ profiler, commandBuffer, "draw indirect" };
+    indirectRenderer->draw( commandBuffer, frameIndex, formatPipelines );
+    frameTelemetry.drawCount += indirectRenderer->getDrawCallCount();
+    return;
+  }
+
+  // sorted so that objects sharing a pipeline and a model come one after
+  // the other and share its binds. 2d objects have no depth; the sort is
+  // stable, so they keep their order within a model
+  renderQueue.clear();
+  for ( uint32_t i = 0; i < gameObjects.size(); i++ ) {
+    const Model& model = getDrawModel( gameObjects[i] );
+    Pipeline& pipeline = *pipelines[static_cast< uint32_t >(
+        model.getVertexFormat() )];
+    renderQueue.submit(
+        RenderQueue::makeKey( pipeline.getId(), model.getId(), 0.f ), i );
+  }
+  renderQueue.sort();
+  const auto& items = renderQueue.getItems();
+
+  // the objects are written in draw order in one pass; draw i passes i as
+  // firstInstance, which the vertex shader sees as gl_InstanceIndex. The
+  // fence of this frame slot has been waited for, so nothing reads the
+  // buffer anymore. It never is empty, so the descriptor is always valid
+  uint32_t frameIndex = static_cast< uint32_t >( swapChain->getCurrentFrame() );
+  if ( objectBuffer.reserve(
+           frameIndex,
+           std::max( items.size(), size_t( 1 ) ) * sizeof( ObjectData ) ) )
+    updateObjectDescriptorSet( frameIndex );
+  auto* objects =
+      static_cast< ObjectData* >( objectBuffer.getMappedMemory( frameIndex ) );
+  for ( size_t i = 0; i < items.size(); i++ ) {
+    const GameObject& object = gameObjects[items[i].object];
+    Transform2dComponent transform = object.getRenderTransform( alpha );
+    glm::mat2 matrix = transform.mat2();
+    glm::vec2 offset = transform.translation;
+    getDrawModel( object ).dequantize( matrix, offset );
+    objects[i].transform = {
+      matrix[0][0], matrix[0][1], matrix[1][0], matrix[1][1] };
+    objects[i].offset = offset;
+    objects[i].color = glm::vec4( object.color, 1.f );
+  }
+  frameTelemetry.uploadBytes += items.size() * sizeof( ObjectData );
+
+  vkCmdBindDescriptorSets(
+      commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+      &objectDescriptorSets[frameIndex], 0, nullptr );
+
+  // one scope for all of them: a scope per draw would build a name per
+  // object and run out of queries in larger scenes
+  Profiler::Scope scope{ profiler, commandBuffer, "draw objects" };
+
+  // every model lives in the geometry pool, so its vertex and index buffers
+  // stay bound from one model to the next; they only need binding again when
+  // the index type changes, which is all boundIndexType tracks
+  Pipeline* boundPipeline = nullptr;
+  VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+  for ( uint32_t i = 0; i < items.size(); i++ ) {
+    const GameObject& object = gameObjects[items[i].object];
+    Model* model = &getDrawModel( object );
+
+    uint32_t format = static_cast< uint32_t >( model->getVertexFormat() );
+    Pipeline* pipeline = pipelines[format].get();
+    bool pipelineBound = boundPipeline == pipeline;
+    renderQueue.countPipelineBind( pipelineBound );
+    if ( !pipelineBound ) {
+      Profiler::Scope scope{ profiler, commandBuffer, "bind pipeline" };
+      pipeline->bind( commandBuffer );
+      boundPipeline = pipeline;
+    }
+
+    bool geometryBound = boundIndexType == model->getIndexType();
+    renderQueue.countGeometryBind( geometryBound );
+    if ( !geometryBound ) {
+      model->bind( commandBuffer );
+      boundIndexType = model->getIndexType();
+    }
+    model->draw( commandBuffer, 1, i );
+    frameTelemetry.drawCount++;
+  }
+}
 
+void FirstApp::updateGameObjects( float dt ) {
+  simulationTime += dt;
   for ( auto& object: gameObjects ) {
-    object.transform2d.rotation =
-        glm::mod( object.transform2d.rotation + 0.01f, glm::two_pi< float >() );
+    object.previousTransform2d = object.transform2d;
+    object.transform2d.rotation = glm::mod(
+        object.transform2d.rotation + ROTATION_SPEED * dt,
+        glm::two_pi< float >() );
+  }
+}
+
+void FirstApp::groupObjectsByModel() {
+  // count the objects of every model first, then give each model a
+  // contiguous range of instances
+  batches.clear();
+  batchLookup.clear();
+  objectBatches.resize( gameObjects.size() );
+  objectSlots.resize( gameObjects.size() );
+
+  for ( size_t i = 0; i < gameObjects.size(); i++ ) {
+    Model* model = &getDrawModel( gameObjects[i] );
+    auto inserted = batchLookup.emplace(
+        model, static_cast< uint32_t >( batches.size() ) );
+    if ( inserted.second ) batches.push_back( { model, 0, 0 } );
+
+    objectBatches[i] = inserted.first->second;
+    objectSlots[i] = batches[inserted.first->second].instanceCount++;
+  }
+
+  uint32_t firstInstance = 0;
+  for ( auto& batch: batches ) {
+    batch.firstInstance = firstInstance;
+    firstInstance += batch.instanceCount;
+  }
+}
 
-    SimplePushConstantData push{};
-    push.offset = object.transform2d.translation;
-    push.color = object.color;
-    push.transform = object.transform2d.mat2();
+void FirstApp::renderGameObjectsInstanced(
+    VkCommandBuffer commandBuffer, float alpha ) {
+  if ( gameObjects.empty() ) return;
 
-    vkCmdPushConstants(
-        commandBuffer, pipelineLayout,
-        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-        sizeof( SimplePushConstantData ), &push );
+  // the fence of this frame slot has been waited for, so its buffer is no
+  // longer read by the GPU and can be overwritten
+  uint32_t frameIndex = static_cast< uint32_t >( swapChain->getCurrentFrame() );
+  instanceBuffer.reserve(
+      frameIndex, gameObjects.size() * sizeof( Model::Instance ) );
+  auto* data = static_cast< Model::Instance* >(
+      instanceBuffer.getMappedMemory( frameIndex ) );
 
-    object.model->bind( commandBuffer );
-    object.model->draw( commandBuffer );
+  for ( size_t i = 0; i < gameObjects.size(); i++ ) {
+    const GameObject& object = gameObjects[i];
+    Transform2dComponent transform = object.getRenderTransform( alpha );
+    const DrawBatch& batch = batches[objectBatches[i]];
+    Model::Instance& instance = data[batch.firstInstance + objectSlots[i]];
+    instance.transform = transform.mat2();
+    instance.offset = transform.translation;
+    batch.model->dequantize( instance.transform, instance.offset );
+    instance.color = object.color;
   }
+  frameTelemetry.uploadBytes += gameObjects.size() * sizeof( Model::Instance );
+
+  // the instance buffer stays bound across pipeline binds, they all share
+  // the layout
+  VkBuffer instances = instanceBuffer.getBuffer( frameIndex );
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers( commandBuffer, 1, 1, &instances, &offset );
+
+  // like the objects above, timed as a whole
+  Profiler::Scope scope{ profiler, commandBuffer, "draw models" };
+  Pipeline* boundPipeline = nullptr;
+  VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+  for ( size_t i = 0; i < batches.size(); i++ ) {
+    const DrawBatch& batch = batches[i];
+    uint32_t format =
+        static_cast< uint32_t >( batch.model->getVertexFormat() );
+    Pipeline* pipeline = instancedPipelines[format].get();
+    if ( pipeline != boundPipeline ) {
+      Profiler::Scope scope{ profiler, commandBuffer, "bind pipeline" };
+      pipeline->bind( commandBuffer );
+      boundPipeline = pipeline;
+    }
+
+    if ( batch.model->getIndexType() != boundIndexType ) {
+      batch.model->bind( commandBuffer );
+      boundIndexType = batch.model->getIndexType();
+    }
+    batch.model->draw(
+        commandBuffer, batch.instanceCount, batch.firstInstance );
+    frameTelemetry.drawCount++;
+  }
+}
+
+void FirstApp::renderDynamicGeometry(
+    VkCommandBuffer commandBuffer, float alpha ) {
+  // the depth changes every second, so the vertex count does too
+  float time =
+      static_cast< float >( simulationTime + alpha * SIMULATION_STEP );
+  unsigned char depth = static_cast< unsigned char >(
+      1 + static_cast< int >( time ) % DYNAMIC_MAX_DEPTH );
+  Model::Triangle corners{};
+  Model::Vertex* cornerVertices[] = { &corners.a, &corners.b, &corners.c };
+  float radius = 0.25f + 0.05f * glm::sin( 3.f * time );
+  for ( int i = 0; i < 3; i++ ) {
+    float angle = time + i * glm::two_pi< float >() / 3.f;
+    cornerVertices[i]->position =
+        glm::vec2{ 0.65f, -0.65f } +
+        radius * glm::vec2{ glm::cos( angle ), glm::sin( angle ) };
+  }
+
+  // the fence of this frame slot has been waited for, so its region and
+  // instance are no longer read and are generated into in place
+  uint32_t frameIndex = static_cast< uint32_t >( swapChain->getCurrentFrame() );
+  uint32_t vertexCount =
+      static_cast< uint32_t >( sierpinskiTriangleCount( depth ) * 3 );
+  dynamicModel->resize( frameIndex, vertexCount, vertexCount );
+  sierpinski( depth, &corners, 1, dynamicModel->getVertices( frameIndex ) );
+  uint32_t* indices = dynamicModel->getIndices( frameIndex );
+  for ( uint32_t i = 0; i < vertexCount; i++ ) indices[i] = i;
+
+  dynamicInstanceBuffer.reserve( frameIndex, sizeof( Model::Instance ) );
+  auto* instance = static_cast< Model::Instance* >(
+      dynamicInstanceBuffer.getMappedMemory( frameIndex ) );
+  instance->transform = glm::mat2{ 1.f };
+  instance->offset = { 0.f, 0.f };
+  instance->color = { 1.f, 0.8f, 0.2f };
+  frameTelemetry.uploadBytes +=
+      dynamicModel->getBytes( frameIndex ) + sizeof( Model::Instance );
+
+  Profiler::Scope scope{ profiler, commandBuffer, "draw dynamic" };
+  instancedPipelines[static_cast< uint32_t >( VertexFormat::Float32 )]->bind(
+      commandBuffer );
+  VkBuffer instances = dynamicInstanceBuffer.getBuffer( frameIndex );
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers( commandBuffer, 1, 1, &instances, &offset );
+  dynamicModel->bind( commandBuffer, frameIndex );
+  dynamicModel->draw( commandBuffer, frameIndex );
+  frameTelemetry.drawCount++;
 }
 
-void FirstApp::drawFrame() {
+void FirstApp::drawFrame( float alpha ) {
+  using clock = std::chrono::steady_clock;
+  using milliseconds = std::chrono::duration< double, std::milli >;
+
+  frameTelemetry = FrameTelemetry{};
+  frameTelemetry.frame = drawnFrames++;
+
+  auto acquireStart = clock::now();
   uint32_t imageIndex;
   auto result = swapChain->acquireNextImage( &imageIndex );
+  frameTelemetry.acquireMilliseconds =
+      milliseconds( clock::now() - acquireStart ).count();
 
   if ( result == VK_ERROR_OUT_OF_DATE_KHR ) {
     recreateSwapChain();
@@ -217,13 +877,28 @@ void FirstApp::drawFrame() {
   if ( result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR )
     throw std::runtime_error( "failed to acquire swapchain image" );
 
-  recordCommandBuffer( imageIndex );
+  // recording only reads the game objects; they are advanced by run()
+  auto recordStart = clock::now();
+  recordCommandBuffer( imageIndex, alpha );
+  auto submitStart = clock::now();
   result = swapChain->submitCommandBuffers(
-      &commandBuffers[imageIndex], &imageIndex );
+      &commandBuffers[swapChain->getCurrentFrame()], &imageIndex );
+  auto submitEnd = clock::now();
 
+  const SwapChainTimings& timings = swapChain->getTimings();
+  frameTelemetry.recordMilliseconds =
+      milliseconds( submitStart - recordStart ).count();
+  frameTelemetry.submitMilliseconds =
+      milliseconds( submitEnd - submitStart ).count() - timings.present;
+  frameTelemetry.presentMilliseconds = timings.present;
+  frameTelemetry.acquireFenceWaitMilliseconds = timings.acquireFenceWait;
+  frameTelemetry.submitFenceWaitMilliseconds = timings.submitFenceWait;
+  telemetry.record( frameTelemetry );
+
+  bool resized = window != nullptr && window->wasResized();
   if ( result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
-       window.wasResized() ) {
-    window.resetResizedFlag();
+       resized ) {
+    if ( resized ) window->resetResizedFlag();
     recreateSwapChain();
     return;
   }
@@ -232,52 +907,245 @@ void FirstApp::drawFrame() {
     throw std::runtime_error( "failed to submit command buffers" );
 }
 
-std::vector< Model::Triangle > FirstApp::sierpinskiSplit( Model::Triangle t ) {
-  float ax = t.a.position.x;
-  float ay = t.a.position.y;
-  float bx = t.b.position.x;
-  float by = t.b.position.y;
-  float cx = t.c.position.x;
-  float cy = t.c.position.y;
-
-  // calculate midpoints
-  float abx = ( ax + bx ) / 2;
-  float aby = ( ay + by ) / 2;
-  float bcx = ( bx + cx ) / 2;
-  float bcy = ( by + cy ) / 2;
-  float cax = ( cx + ax ) / 2;
-  float cay = ( cy + ay ) / 2;
-
-  return std::vector< Model::Triangle >{
-    { { { ax, ay }, { 0.f, 0.5f, 0.5f } },
-      { { abx, aby }, { 0.f, 1.f, 0.f } },
-      { { cax, cay }, { 0.f, 0.f, 1.f } } },
-    { { { abx, aby }, { 0.f, 0.5f, 0.5f } },
-      { { bx, by }, { 0.f, 1.f, 0.f } },
-      { { bcx, bcy }, { 0.f, 0.f, 1.f } } },
-    { { { cax, cay }, { 0.f, 0.5f, 0.5f } },
-      { { bcx, bcy }, { 0.f, 1.f, 0.f } },
-      { { cx, cy }, { 0.f, 0.f, 1.f } } }
+Model::GeometryStats FirstApp::getGeometryStats() {
+  Model::GeometryStats total{};
+  double misses = 0.0;
+  std::set< Model* > seen;
+  for ( const auto& object: gameObjects ) {
+    if ( !seen.insert( object.model.get() ).second ) continue;
+
+    const Model::GeometryStats& stats = object.model->getGeometryStats();
+    total.inputVertexCount += stats.inputVertexCount;
+    total.vertexCount += stats.vertexCount;
+    total.indexCount += stats.indexCount;
+    total.bytes += stats.bytes;
+    total.unindexedBytes += stats.unindexedBytes;
+    misses += stats.acmr * ( stats.indexCount / 3 );
+    // the worst of any model
+    total.vertexStride = std::max( total.vertexStride, stats.vertexStride );
+    total.maxPositionError =
+        std::max( total.maxPositionError, stats.maxPositionError );
+    total.positionErrorBound =
+        std::max( total.positionErrorBound, stats.positionErrorBound );
+    total.maxColorError = std::max( total.maxColorError, stats.maxColorError );
+    total.colorErrorBound =
+        std::max( total.colorErrorBound, stats.colorErrorBound );
+  }
+  if ( total.indexCount >= 3 ) total.acmr = misses / ( total.indexCount / 3 );
+  return total;
+}
+
+void FirstApp::printGeometryStats() {
+  Model::GeometryStats stats = getGeometryStats();
+  std::cout << "geometry: " << stats.inputVertexCount
+            << " vertices welded to " << stats.vertexCount << ", "
+            << stats.indexCount << " indices, " << stats.bytes
+            << " bytes instead of " << stats.unindexedBytes << " (saved "
+            << static_cast< int64_t >( stats.unindexedBytes ) -
+                   static_cast< int64_t >( stats.bytes )
+            << "), acmr " << stats.acmr << " (3 without indices)"
+            << std::endl;
+
+  const ModelRegistryStats& registry = modelRegistry.getStats();
+  if ( registry.lookups > 0 ) {
+    std::cout << "model registry: " << registry.hits << " of "
+              << registry.lookups << " lookups hit ("
+              << registry.hitRate() * 100.0 << "%), " << registry.bytesSaved
+              << " bytes saved, " << registry.models << " models in "
+              << registry.bytes << " bytes, " << registry.evictions
+              << " evicted" << std::endl;
+  }
+  GeometryPoolStats pool = device.geometryPool().getStats();
+  std::cout << "geometry pool: " << pool.geometries << " models, "
+            << pool.vertexBytes << " of " << pool.vertexCapacity
+            << " vertex bytes, " << pool.indexBytes << " of "
+            << pool.indexCapacity << " index bytes, " << pool.freeRanges
+            << " free ranges, " << pool.relocations << " relocations ("
+            << pool.relocatedBytes << " bytes)" << std::endl;
+  std::cout << "vertex format: " << vertexFormatName( config.vertexFormat )
+            << ", " << stats.vertexStride << " bytes per vertex, position "
+            << "error " << stats.maxPositionError << " (bound "
+            << stats.positionErrorBound << "), color error "
+            << stats.maxColorError << " (bound " << stats.colorErrorBound
+            << ")" << std::endl;
+}
+
+void FirstApp::loadBenchmarkScene() {
+  const BenchmarkScene& scene = config.benchmarkScene;
+  if ( scene.sierpinskiDepth > SIERPINSKI_MAX_DEPTH )
+    throw std::runtime_error( "sierpinski depth is too large!" );
+  std::mt19937 random{ scene.seed };
+  auto uniform = [&random]( float min, float max ) {
+    return std::uniform_real_distribution< float >{ min, max }( random );
   };
+
+  // every model is a sierpinski triangle split from a different triangle,
+  // unless they come from files
+  UploadBatch uploads{ device };
+  std::vector< std::shared_ptr< Model > > models = loadMeshFiles( uploads );
+  std::vector< std::vector< Model::Triangle > > initialTriangles;
+  uint32_t uniqueModels = scene.uniqueModelCount > 0 ? scene.uniqueModelCount
+                                                     : scene.modelCount;
+  for ( uint32_t i = 0;
+        models.empty() && i < std::max( scene.modelCount, 1u ); i++ ) {
+    if ( i < std::max( uniqueModels, 1u ) ) {
+      initialTriangles.push_back(
+          { { { { uniform( -0.5f, 0.5f ), uniform( -0.5f, 0.f ) },
+                { 0.f, 0.5f, 0.5f } },
+              { { uniform( 0.f, 0.5f ), uniform( 0.f, 0.5f ) },
+                { 0.f, 1.f, 0.f } },
+              { { uniform( -0.5f, 0.f ), uniform( 0.f, 0.5f ) },
+                { 0.f, 0.f, 1.f } } } } );
+    }
+    std::vector< Model::Triangle > initialTriangle =
+        initialTriangles[i % initialTriangles.size()];
+    auto depth = static_cast< unsigned char >( scene.sierpinskiDepth );
+    VertexFormat format = config.vertexFormat;
+
+    // only the random numbers are drawn here, so that the scene is the same
+    // whichever thread generates it
+    models.push_back( createModel(
+        uploads, [initialTriangle, depth, format]( Model::Builder& builder ) {
+          builder.weld( sierpinski( depth, initialTriangle ) );
+          builder.format = format;
+        } ) );
+  }
+  uploads.flush();
+
+  gameObjects.reserve( scene.objectCount );
+  for ( uint32_t i = 0; i < scene.objectCount; i++ ) {
+    auto object = GameObject::createGameObject();
+    object.model = models[random() % models.size()];
+    object.color = { uniform( 0.f, 1.f ), uniform( 0.f, 1.f ),
+                     uniform( 0.f, 1.f ) };
+    // some of the objects lie outside of the view, for culling to find
+    object.transform2d.translation = { uniform( -1.2f, 1.2f ),
+                                       uniform( -1.2f, 1.2f ) };
+    float scale = uniform( 0.05f, 0.3f );
+    object.transform2d.scale = { scale, scale };
+    object.transform2d.rotation = uniform( 0.f, glm::two_pi< float >() );
+    gameObjects.push_back( std::move( object ) );
+  }
+
+  // streamed models are reported once they are all resident
+  if ( modelLoader == nullptr ) printGeometryStats();
+}
+
+std::vector< std::shared_ptr< Model > > FirstApp::loadMeshFiles(
+    UploadBatch& uploads ) {
+  using clock = std::chrono::steady_clock;
+  auto start = clock::now();
+
+  std::vector< std::shared_ptr< Model > > models;
+  size_t bytes = 0;
+  for ( const auto& path: config.meshPaths ) {
+    if ( modelLoader != nullptr ) {
+      models.push_back( modelLoader->loadFile( path ) );
+      continue;
+    }
+
+    // unmapped right away, the data is in staging memory by then
+    MeshFile file{ path };
+    models.push_back( modelRegistry.get( uploads, file.getView() ) );
+    bytes += file.getSize();
+  }
+
+  meshLoadMilliseconds =
+      std::chrono::duration< double, std::milli >( clock::now() - start )
+          .count();
+  if ( !models.empty() && modelLoader == nullptr ) {
+    std::cout << "loaded " << models.size() << " mesh file(s), " << bytes
+              << " bytes in " << meshLoadMilliseconds << " ms" << std::endl;
+  }
+  return models;
 }
 
-std::vector< Model::Triangle > FirstApp::sierpinski(
-    unsigned char depth, std::vector< Model::Triangle > triangles ) {
-  if ( depth == 0 ) return triangles;
+std::shared_ptr< Model > FirstApp::createModel(
+    UploadBatch& uploads, const ModelLoader::Generator& generate ) {
+  if ( modelLoader != nullptr ) return modelLoader->load( generate );
+
+  Model::Builder builder{};
+  generate( builder );
+  return modelRegistry.get( uploads, builder );
+}
 
-  // this allocates a bunch of memory just to keep the original triangles out of
-  // the final set
-  std::vector< Model::Triangle > out;
+void FirstApp::updateModelLoader() {
+  modelLoader->update();
 
-  for ( auto triangle: triangles ) {
-    std::vector< Model::Triangle > newTriangles = sierpinskiSplit( triangle );
-    out.insert( out.begin(), newTriangles.begin(), newTriangles.end() );
+  // models whose geometry turned out to be in the registry already
+  std::vector< ModelLoader::Replacement > replaced =
+      modelLoader->takeReplaced();
+  if ( !replaced.empty() ) {
+    std::unordered_map< Model*, std::shared_ptr< Model > > replacements;
+    for ( auto& replacement: replaced )
+      replacements[replacement.pending.get()] = replacement.model;
+    for ( auto& object: gameObjects ) {
+      auto replacement = replacements.find( object.model.get() );
+      if ( replacement != replacements.end() )
+        object.model = replacement->second;
+    }
   }
 
-  return sierpinski( depth - 1, out );
+  if ( modelsResidentMilliseconds > 0.0 || modelLoader->getPendingCount() > 0 )
+    return;
+
+  compactGeometry();
+  modelsResidentMilliseconds =
+      std::chrono::duration< double, std::milli >(
+          std::chrono::steady_clock::now() - createdAt )
+          .count();
+  const ModelLoaderStats& stats = modelLoader->getStats();
+  std::cout << stats.resident << " model(s) resident after "
+            << modelsResidentMilliseconds << " ms, " << stats.uploadedBytes
+            << " bytes in " << stats.uploadBatches << " upload(s), "
+            << stats.shared << " shared, " << stats.failed << " failed"
+            << std::endl;
+  printGeometryStats();
+}
+
+void FirstApp::compactGeometry() {
+  GeometryPool& geometryPool = device.geometryPool();
+  if ( geometryPool.isFragmented() ) geometryPool.defragment();
+}
+
+Model& FirstApp::getDrawModel( const GameObject& object ) {
+  if ( object.model->isResident() ) return *object.model;
+  assert( placeholderModel != nullptr && "Model isn't resident" );
+  return *placeholderModel;
 }
 
 void FirstApp::loadGameObjects() {
+  if ( config.useBenchmarkScene ) {
+    loadBenchmarkScene();
+    return;
+  }
+
+  if ( !config.meshPaths.empty() ) {
+    UploadBatch uploads{ device };
+    std::vector< std::shared_ptr< Model > > models = loadMeshFiles( uploads );
+    uploads.flush();
+
+    // side by side across the view, each scaled to fit its slot. The size
+    // of models that are still streaming in isn't known yet, they are
+    // assumed to fit into the unit circle
+    float slot = 2.f / static_cast< float >( models.size() );
+    for ( size_t i = 0; i < models.size(); i++ ) {
+      auto object = GameObject::createGameObject();
+      object.model = models[i];
+      object.color = { 0.1f, 0.8f, 0.1f };
+      object.transform2d.translation.x =
+          -1.f + slot * ( static_cast< float >( i ) + 0.5f );
+      float radius = models[i]->isResident() ? models[i]->getBoundingRadius()
+                                             : 1.f;
+      float scale = slot * 0.5f / glm::max( radius, 1e-6f );
+      object.transform2d.scale = { scale, scale };
+      gameObjects.push_back( std::move( object ) );
+    }
+    // streamed models are reported once they are all resident
+    if ( modelLoader == nullptr ) printGeometryStats();
+    return;
+  }
+
   /*
   std::vector< Model::Triangle > initialTriangle{
     { { { 0.f, -0.5f } }, { { 0.5f, 0.8f } }, { { -0.7f, 0.5f } } }
@@ -302,7 +1170,12 @@ void FirstApp::loadGameObjects() {
                                          { { -0.5f, 0.5f },
                                            { 0.f, 0.f, 1.f } } };
 
-  auto model = std::make_shared< Model >( device, vertices );
+  // all model uploads share one submission
+  UploadBatch uploads{ device };
+  Model::Builder builder{};
+  builder.weld( vertices );
+  builder.format = config.vertexFormat;
+  auto model = std::make_shared< Model >( device, uploads, builder );
   auto triangle = GameObject::createGameObject();
   triangle.model = model;
   triangle.color = { 0.1f, 0.8f, 0.1f };
@@ -310,6 +1183,15 @@ void FirstApp::loadGameObjects() {
   triangle.transform2d.scale = { 2.f, 0.5f };
   triangle.transform2d.rotation = 0.25f * glm::two_pi< float >();
   gameObjects.push_back( std::move( triangle ) );
+
+  uploads.flush();
+
+  const UploadBatchStats& stats = uploads.getStats();
+  std::cout << "uploaded " << stats.bytes << " bytes of geometry in "
+            << stats.recordedRegions << " copies (" << stats.requestedRegions
+            << " requested), " << stats.submissions << " submission(s)"
+            << std::endl;
+  printGeometryStats();
 }
 
 }  // namespace lve
@@ -1,46 +1,234 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <map>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "dynamic_model.hpp"
 #include "game_object.hpp"
+#include "indirect_renderer.hpp"
 #include "model.hpp"
+#include "model_loader.hpp"
+#include "model_registry.hpp"
+#include "per_frame_buffer.hpp"
 #include "pipeline.hpp"
+#include "profiler.hpp"
+#include "render_queue.hpp"
+#include "sierpinski.hpp"
 #include "swap_chain.hpp"
+#include "telemetry.hpp"
 #include "window.hpp"
 
 namespace lve {
 
+enum class RenderMode {
+  // a draw for every object, which finds its data in a storage buffer
+  PerObject,
+  // objects that share a model are drawn with a single instanced draw
+  Instanced,
+  // objects are culled by a compute shader, which also fills in the
+  // instance counts of one indirect draw per model
+  Indirect
+};
+
+// a generated scene in place of the usual one, for benchmarks. The same
+// parameters always give the same scene
+struct BenchmarkScene {
+  uint32_t objectCount = 1000;
+  // models the objects are spread over
+  uint32_t modelCount = 4;
+  // how many of them have geometry of their own; the others repeat it, like
+  // procedural scenes that come up with the same mesh many times. 0 makes
+  // every model distinct
+  uint32_t uniqueModelCount = 0;
+  // of the sierpinski triangle each model is made of
+  uint32_t sierpinskiDepth = 3;
+  uint32_t seed = 1;
+};
+
+struct AppConfig {
+  // render into offscreen images instead of a window, e.g. for benchmarks on
+  // machines without a display
+  bool headless = false;
+  // stop after this many frames; 0 runs until the window is closed
+  uint32_t frameCount = 0;
+  // drain the GPU after every frame like the loop used to; only useful to
+  // measure what keeping frames in flight buys
+  bool waitIdleEachFrame = false;
+  RenderMode renderMode = RenderMode::Instanced;
+  // can also be changed while running: P cycles the present mode, + and -
+  // change the number of swap chain images
+  SwapChainSettings swapChainSettings{};
+
+  bool useBenchmarkScene = false;
+  BenchmarkScene benchmarkScene{};
+  // advance the simulation by exactly one step per frame instead of by real
+  // time, so that every run draws the same frames
+  bool fixedSimulationSteps = false;
+  // if set, run() writes its results there as JSON
+  std::string reportPath;
+  // of every model the app creates
+  VertexFormat vertexFormat = VertexFormat::Float32;
+  // mesh files (see mesh_file.hpp) to use as models instead of generated
+  // ones; their vertex format is whatever they were written with
+  std::vector< std::string > meshPaths;
+  // generate or read the models of the benchmark scene and the mesh files
+  // on background threads; the first frames draw a placeholder for the
+  // ones that aren't resident yet
+  bool streamModels = false;
+  // draw an animated sierpinski triangle on top, generated again every
+  // frame into a DynamicModel
+  bool dynamicGeometry = false;
+};
+
 class FirstApp {
  private:
   static constexpr int width = 800;
   static constexpr int height = 600;
-  Window window{ width, height, "Hello Vulkan!" };
+  // length of one simulation step in seconds
+  static constexpr double SIMULATION_STEP = 1.0 / 60.0;
+  // longest frame the simulation catches up on
+  static constexpr double MAX_FRAME_TIME = 0.25;
+  // radians per second, what 0.01 per frame used to be at 60 fps
+  static constexpr float ROTATION_SPEED = 0.6f;
+  // the dynamic sierpinski triangle cycles through depths 1 to this
+  static constexpr int DYNAMIC_MAX_DEPTH = 6;
+  AppConfig config;
+  std::chrono::steady_clock::time_point createdAt =
+      std::chrono::steady_clock::now();
+  // null when headless
+  std::unique_ptr< Window > window;
 
-  Device device{ window };
+  Device device{ window.get() };
+  Profiler profiler{ device, SwapChain::MAX_FRAMES_IN_FLIGHT };
   std::unique_ptr< SwapChain > swapChain;
-  std::unique_ptr< Pipeline > pipeline;
+  // one of each per vertex format, indexed by it; they only differ in their
+  // vertex input state
+  std::array< std::unique_ptr< Pipeline >, VERTEX_FORMAT_COUNT > pipelines;
+  std::array< std::unique_ptr< Pipeline >, VERTEX_FORMAT_COUNT >
+      instancedPipelines;
   VkPipelineLayout pipelineLayout;
+  // set 0 of pipelineLayout, one set per frame in flight
+  VkDescriptorSetLayout objectSetLayout;
+  VkDescriptorPool descriptorPool;
+  std::vector< VkDescriptorSet > objectDescriptorSets;
   std::vector< VkCommandBuffer > commandBuffers;
   std::vector< GameObject > gameObjects;
 
+  // instance data of the instanced path, written by the CPU every frame
+  PerFrameBuffer instanceBuffer{
+      device, SwapChain::MAX_FRAMES_IN_FLIGHT,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT };
+  // object data of the per object path, indexed by gl_InstanceIndex
+  PerFrameBuffer objectBuffer{
+      device, SwapChain::MAX_FRAMES_IN_FLIGHT,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT };
+  // only created for RenderMode::Indirect
+  std::unique_ptr< IndirectRenderer > indirectRenderer;
+  // shares models between identical meshes; streamed ones go through it
+  // once the loader has them
+  ModelRegistry modelRegistry{ device };
+  // only created with config.streamModels, like the placeholder that is
+  // drawn in place of models that are still loading
+  std::unique_ptr< ModelLoader > modelLoader;
+  std::shared_ptr< Model > placeholderModel;
+  // only created with config.dynamicGeometry, drawn as a single instance
+  // with the instanced pipeline in every render mode
+  std::unique_ptr< DynamicModel > dynamicModel;
+  PerFrameBuffer dynamicInstanceBuffer{
+      device, SwapChain::MAX_FRAMES_IN_FLIGHT,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT };
+  // seconds the simulation has advanced
+  double simulationTime = 0.0;
+
+  // objects grouped by model, rebuilt every frame; the vectors are kept
+  // around to reuse their memory. objectBatches[i] is the batch of
+  // gameObjects[i], objectSlots[i] its position within the batch
+  std::vector< DrawBatch > batches;
+  std::vector< uint32_t > objectBatches;
+  std::vector< uint32_t > objectSlots;
+  std::unordered_map< Model*, uint32_t > batchLookup;
+  // draw order of the per object path
+  RenderQueue renderQueue;
+
+  // frame times and submit to present latencies in milliseconds, for every
+  // present mode and image count the app ran with
+  struct PresentStats {
+    RollingStats frameTimes{ 10000 };
+    RollingStats latencies{ 10000 };
+  };
+  std::map< std::pair< VkPresentModeKHR, size_t >, PresentStats >
+      presentStats;
+  std::vector< double > latencySamples;
+
+  // CPU side of every frame; written out at exit, or when T is pressed
+  Telemetry telemetry;
+  // filled in while the current frame is drawn
+  FrameTelemetry frameTelemetry;
+  uint64_t drawnFrames = 0;
+  // mapping the mesh files and copying them into staging memory
+  double meshLoadMilliseconds = 0.0;
+  // since the app was created
+  double firstFrameMilliseconds = 0.0;
+  double modelsResidentMilliseconds = 0.0;
+
   void createPipelineLayout();
   void createPipeline();
+  void createDescriptorSets();
+  void updateObjectDescriptorSet( uint32_t frameIndex );
   void createCommandBuffers();
-  void freeCommandBuffers();
-  void drawFrame();
+  // alpha is how far the frame lies between the previous and the current
+  // simulation step
+  void drawFrame( float alpha );
   void loadGameObjects();
-  void renderGameObjects( VkCommandBuffer );
-
-  std::vector< Model::Triangle > sierpinskiSplit( Model::Triangle );
-  std::vector< Model::Triangle > sierpinski(
-      unsigned char, std::vector< Model::Triangle > );
+  void loadBenchmarkScene();
+  // one model per entry of config.meshPaths
+  std::vector< std::shared_ptr< Model > > loadMeshFiles( UploadBatch& );
+  // on the model loader if there is one, otherwise right away; through the
+  // registry either way
+  std::shared_ptr< Model > createModel(
+      UploadBatch&, const ModelLoader::Generator& generate );
+  void updateModelLoader();
+  // defragments the geometry pool if models that went away left enough
+  // holes. Moving it waits for the copy, so this is only called once
+  // loading is done, never from the frame loop
+  void compactGeometry();
+  // the object's model, or the placeholder while it isn't resident
+  Model& getDrawModel( const GameObject& object );
+  // summed over every distinct model of the game objects; acmr is averaged
+  // over all their triangles
+  Model::GeometryStats getGeometryStats();
+  void printGeometryStats();
+  void writeReport(
+      const std::string& path, uint32_t frames, double seconds,
+      const RollingStats& frameTimes );
+  void renderGameObjects( VkCommandBuffer, float alpha );
+  void renderGameObjectsInstanced( VkCommandBuffer, float alpha );
+  void renderDynamicGeometry( VkCommandBuffer, float alpha );
+  void updateGameObjects( float dt );
+  void groupObjectsByModel();
+  void handleKeyPresses();
+  void recordPresentStats( double frameTime );
+  void printPresentStats();
+  void writeTelemetry();
 
+  VkExtent2D getExtent();
   void recreateSwapChain();
-  void recordCommandBuffer( int );
+  void recordCommandBuffer( int, float alpha );
 
  public:
-  FirstApp();
+  FirstApp( AppConfig config = AppConfig{} );
   ~FirstApp();
   FirstApp( const FirstApp& ) = delete;
   FirstApp& operator=( const FirstApp& ) = delete;
@@ -4,6 +4,8 @@
 
 #include "model.hpp"
 
+#include <glm/gtc/constants.hpp>
+
 namespace lve {
 
 struct Transform2dComponent {
@@ -11,13 +13,28 @@ struct Transform2dComponent {
   glm::vec2 scale{ 1.f, 1.f };
   float rotation;
 
-  glm::mat2 mat2() {
+  glm::mat2 mat2() const {
     const float s = glm::sin( rotation );
     const float c = glm::cos( rotation );
     glm::mat2 scaleMat{ { scale.x, 0.f }, { 0.f, scale.y } };
     glm::mat2 rotMat{ { c, s }, { -s, c } };
     return rotMat * scaleMat;
   }
+
+  // the state alpha of the way from previous to this one; rotation takes the
+  // short way around, since it wraps at two pi
+  Transform2dComponent interpolateFrom(
+      const Transform2dComponent& previous, float alpha ) const {
+    float delta = rotation - previous.rotation;
+    if ( delta > glm::pi< float >() ) delta -= glm::two_pi< float >();
+    if ( delta < -glm::pi< float >() ) delta += glm::two_pi< float >();
+
+    Transform2dComponent out{};
+    out.translation = glm::mix( previous.translation, translation, alpha );
+    out.scale = glm::mix( previous.scale, scale, alpha );
+    out.rotation = previous.rotation + delta * alpha;
+    return out;
+  }
 };
 
 class GameObject {
@@ -36,13 +53,20 @@ class GameObject {
   std::shared_ptr< Model > model{};
   glm::vec3 color{};
   Transform2dComponent transform2d;
+  // state as of the previous simulation step, rendering blends between the
+  // two
+  Transform2dComponent previousTransform2d;
 
   static GameObject createGameObject() {
     static id_t currentId = 0;
     return GameObject( currentId++ );
   }
 
-  id_t getId() { return id; }
+  id_t getId() const { return id; }
+
+  Transform2dComponent getRenderTransform( float alpha ) const {
+    return transform2d.interpolateFrom( previousTransform2d, alpha );
+  }
 };
 
 }  // namespace lve
@@ -0,0 +1,250 @@
+#include "geometry_pool.hpp"
+
+#include "device.hpp"
+#include "upload_batch.hpp"
+
+// std headers
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace lve {
+
+// both are copied from when the pool moves into new buffers
+static constexpr VkBufferUsageFlags VERTEX_USAGE =
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+static constexpr VkBufferUsageFlags INDEX_USAGE =
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+GeometryPool::GeometryPool( Device& _device ) : device{ _device } {
+  vertices = createArena( INITIAL_VERTEX_CAPACITY, VERTEX_USAGE );
+  indices = createArena( INITIAL_INDEX_CAPACITY, INDEX_USAGE );
+}
+
+GeometryPool::~GeometryPool() {
+  for ( Arena* arena: { &vertices, &indices } ) {
+    vkDestroyBuffer( device.device(), arena->buffer, nullptr );
+    device.freeMemory( arena->allocation );
+  }
+}
+
+GeometryPool::Arena GeometryPool::createArena(
+    VkDeviceSize capacity, VkBufferUsageFlags usage ) {
+  Arena arena;
+  device.createBuffer(
+      capacity, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, arena.buffer,
+      arena.allocation );
+  arena.ranges = RangeAllocator{ capacity };
+  return arena;
+}
+
+GeometryPool::Handle GeometryPool::allocate(
+    UploadBatch& batch, uint32_t vertexStride, uint32_t vertexCount,
+    uint32_t indexSize, uint32_t indexCount ) {
+  Geometry geometry;
+  geometry.vertexStride = vertexStride;
+  geometry.vertexBytes = VkDeviceSize( vertexStride ) * vertexCount;
+  geometry.indexSize = indexSize;
+  geometry.indexBytes = VkDeviceSize( indexSize ) * indexCount;
+  geometry.used = true;
+
+  if ( !tryAllocate( geometry ) ) {
+    // the copies queued so far have to be in the old buffers before those
+    // can be copied over
+    if ( !batch.empty() ) batch.flush();
+
+    // twice what is needed leaves room for the alignment padding and for
+    // more geometry after this one
+    VkDeviceSize vertexCapacity = std::max(
+        vertices.ranges.capacity() * 2,
+        ( vertices.ranges.usedSize() + geometry.vertexBytes ) * 2 );
+    VkDeviceSize indexCapacity = std::max(
+        indices.ranges.capacity() * 2,
+        ( indices.ranges.usedSize() + geometry.indexBytes ) * 2 );
+    relocate( vertexCapacity, indexCapacity );
+
+    if ( !tryAllocate( geometry ) )
+      throw std::runtime_error( "failed to allocate pool geometry!" );
+  }
+
+  if ( !freeHandles.empty() ) {
+    Handle handle = freeHandles.back();
+    freeHandles.pop_back();
+    geometries[handle] = geometry;
+    return handle;
+  }
+  geometries.push_back( geometry );
+  return static_cast< Handle >( geometries.size() - 1 );
+}
+
+bool GeometryPool::tryAllocate( Geometry& geometry ) {
+  uint64_t vertexOffset;
+  if ( !vertices.ranges.allocate(
+           geometry.vertexBytes, geometry.vertexStride, vertexOffset ) )
+    return false;
+
+  uint64_t indexOffset;
+  if ( !indices.ranges.allocate(
+           geometry.indexBytes, geometry.indexSize, indexOffset ) ) {
+    vertices.ranges.free( vertexOffset, geometry.vertexBytes );
+    return false;
+  }
+
+  geometry.vertexOffset = vertexOffset;
+  geometry.indexOffset = indexOffset;
+  return true;
+}
+
+void GeometryPool::free( Handle handle ) {
+  Geometry& geometry = geometries[handle];
+  assert( geometry.used && "Geometry is already free" );
+  vertices.ranges.free( geometry.vertexOffset, geometry.vertexBytes );
+  indices.ranges.free( geometry.indexOffset, geometry.indexBytes );
+  geometry.used = false;
+  freeHandles.push_back( handle );
+}
+
+void GeometryPool::uploadVertices(
+    UploadBatch& batch, Handle handle, const void* data ) {
+  const Geometry& geometry = geometries[handle];
+  batch.uploadToBuffer(
+      vertices.buffer, data, geometry.vertexBytes, geometry.vertexOffset );
+}
+
+void GeometryPool::uploadIndices(
+    UploadBatch& batch, Handle handle, const void* data ) {
+  const Geometry& geometry = geometries[handle];
+  batch.uploadToBuffer(
+      indices.buffer, data, geometry.indexBytes, geometry.indexOffset );
+}
+
+void GeometryPool::bind( VkCommandBuffer commandBuffer, VkIndexType type ) {
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers( commandBuffer, 0, 1, &vertices.buffer, &offset );
+  vkCmdBindIndexBuffer( commandBuffer, indices.buffer, 0, type );
+}
+
+bool GeometryPool::isFragmented() const {
+  // holes that add up to less than an eighth of the buffer aren't worth
+  // waiting for a copy
+  for ( const Arena* arena: { &vertices, &indices } ) {
+    const RangeAllocator& ranges = arena->ranges;
+    uint64_t freeSize = ranges.capacity() - ranges.usedSize();
+    uint64_t holes = freeSize - ranges.largestFreeRange();
+    if ( holes > ranges.capacity() / 8 && holes > freeSize / 2 ) return true;
+  }
+  return false;
+}
+
+void GeometryPool::defragment() {
+  relocate( vertices.ranges.capacity(), indices.ranges.capacity() );
+}
+
+void GeometryPool::relocate(
+    VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity ) {
+  assert(
+      device.getUnflushedBatchCount() == 0 &&
+      "Relocating the pool with unflushed copies into it" );
+  // copies into the old buffers may still be in flight
+  device.collectUploads( true );
+
+  Arena newVertices = createArena( vertexCapacity, VERTEX_USAGE );
+  Arena newIndices = createArena( indexCapacity, INDEX_USAGE );
+
+  // geometry of the same stride goes next to each other, so that aligning
+  // the ranges leaves no gaps but between strides
+  std::vector< Handle > order;
+  for ( Handle handle = 0; handle < geometries.size(); handle++ )
+    if ( geometries[handle].used ) order.push_back( handle );
+
+  std::vector< VkBufferCopy > vertexRegions;
+  std::stable_sort( order.begin(), order.end(), [this]( Handle a, Handle b ) {
+    return geometries[a].vertexStride > geometries[b].vertexStride;
+  } );
+  for ( Handle handle: order ) {
+    Geometry& geometry = geometries[handle];
+    uint64_t offset;
+    bool fits = newVertices.ranges.allocate(
+        geometry.vertexBytes, geometry.vertexStride, offset );
+    assert( fits && "Pool vertices don't fit the new buffer" );
+    (void)fits;
+    vertexRegions.push_back(
+        { geometry.vertexOffset, offset, geometry.vertexBytes } );
+    relocatedBytes += geometry.vertexBytes;
+    geometry.vertexOffset = offset;
+  }
+
+  std::vector< VkBufferCopy > indexRegions;
+  std::stable_sort( order.begin(), order.end(), [this]( Handle a, Handle b ) {
+    return geometries[a].indexSize > geometries[b].indexSize;
+  } );
+  for ( Handle handle: order ) {
+    Geometry& geometry = geometries[handle];
+    uint64_t offset;
+    bool fits = newIndices.ranges.allocate(
+        geometry.indexBytes, geometry.indexSize, offset );
+    assert( fits && "Pool indices don't fit the new buffer" );
+    (void)fits;
+    indexRegions.push_back(
+        { geometry.indexOffset, offset, geometry.indexBytes } );
+    relocatedBytes += geometry.indexBytes;
+    geometry.indexOffset = offset;
+  }
+
+  if ( !vertexRegions.empty() ) {
+    VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+    vkCmdCopyBuffer(
+        commandBuffer, vertices.buffer, newVertices.buffer,
+        static_cast< uint32_t >( vertexRegions.size() ),
+        vertexRegions.data() );
+    vkCmdCopyBuffer(
+        commandBuffer, indices.buffer, newIndices.buffer,
+        static_cast< uint32_t >( indexRegions.size() ), indexRegions.data() );
+
+    // frames are submitted to the same queue afterwards
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0,
+        nullptr );
+    device.endSingleTimeCommands( commandBuffer );
+  }
+
+  // frames in flight still draw from the old buffers
+  Device& owner = device;
+  for ( Arena* arena: { &vertices, &indices } ) {
+    VkBuffer buffer = arena->buffer;
+    Allocation allocation = arena->allocation;
+    device.deferDestruction( [&owner, buffer, allocation]() mutable {
+      vkDestroyBuffer( owner.device(), buffer, nullptr );
+      owner.freeMemory( allocation );
+    } );
+  }
+
+  vertices = std::move( newVertices );
+  indices = std::move( newIndices );
+  relocations++;
+}
+
+GeometryPoolStats GeometryPool::getStats() const {
+  GeometryPoolStats stats;
+  stats.vertexCapacity = vertices.ranges.capacity();
+  stats.vertexBytes = vertices.ranges.usedSize();
+  stats.indexCapacity = indices.ranges.capacity();
+  stats.indexBytes = indices.ranges.usedSize();
+  stats.freeRanges =
+      vertices.ranges.freeRangeCount() + indices.ranges.freeRangeCount();
+  stats.geometries =
+      static_cast< uint32_t >( geometries.size() - freeHandles.size() );
+  stats.relocations = relocations;
+  stats.relocatedBytes = relocatedBytes;
+  return stats;
+}
+
+}  // namespace lve
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "memory_allocator.hpp"
+#include "range_allocator.hpp"
+
+// std lib headers
+#include <cstdint>
+#include <vector>
+
+namespace lve {
+
+class Device;
+class UploadBatch;
+
+struct GeometryPoolStats {
+  VkDeviceSize vertexCapacity = 0;
+  VkDeviceSize vertexBytes = 0;
+  VkDeviceSize indexCapacity = 0;
+  VkDeviceSize indexBytes = 0;
+  // free ranges of both buffers; only a few when the pool is compact
+  size_t freeRanges = 0;
+  uint32_t geometries = 0;
+  // moves into new buffers, to grow or to defragment
+  uint32_t relocations = 0;
+  VkDeviceSize relocatedBytes = 0;
+};
+
+// all model geometry lives in one device local vertex buffer and one index
+// buffer, so that switching models doesn't mean binding new buffers: both
+// are bound once and draws pick their geometry through firstIndex and
+// vertexOffset. This is also what lets draws of different models be merged
+// into one multi draw indirect call.
+//
+// The vertex buffer is addressed in bytes, and every range is aligned to its
+// vertex stride so that vertexOffset can count vertices; models of every
+// vertex format share it. Index ranges are aligned to their index size the
+// same way. Freed ranges merge with their free neighbours, and defragment()
+// moves everything to the front of new buffers. Geometry is referred to by
+// a handle that stays the same when its data moves
+class GeometryPool {
+ public:
+  using Handle = uint32_t;
+  static constexpr Handle NO_GEOMETRY = UINT32_MAX;
+
+  static constexpr VkDeviceSize INITIAL_VERTEX_CAPACITY = 8 * 1024 * 1024;
+  static constexpr VkDeviceSize INITIAL_INDEX_CAPACITY = 4 * 1024 * 1024;
+
+  GeometryPool( Device& );
+  // the device has to be idle
+  ~GeometryPool();
+  GeometryPool( const GeometryPool& ) = delete;
+  GeometryPool& operator=( const GeometryPool& ) = delete;
+
+  // reserves room for the geometry. If it doesn't fit, the pool grows into
+  // larger buffers; the batch is flushed first since its copies still point
+  // at the old ones, and the device waits for the copy over
+  Handle allocate(
+      UploadBatch&, uint32_t vertexStride, uint32_t vertexCount,
+      uint32_t indexSize, uint32_t indexCount );
+  // the ranges are reused right away, so frames that may still draw from
+  // them have to have completed, e.g. through Device::deferDestruction
+  void free( Handle );
+
+  // queue the copy of the whole vertex or index range on the batch
+  void uploadVertices( UploadBatch&, Handle, const void* data );
+  void uploadIndices( UploadBatch&, Handle, const void* data );
+
+  // in vertices and indices, as vkCmdDrawIndexed takes them
+  int32_t getVertexOffset( Handle handle ) const {
+    const Geometry& geometry = geometries[handle];
+    return static_cast< int32_t >(
+        geometry.vertexOffset / geometry.vertexStride );
+  }
+  uint32_t getFirstIndex( Handle handle ) const {
+    const Geometry& geometry = geometries[handle];
+    return static_cast< uint32_t >(
+        geometry.indexOffset / geometry.indexSize );
+  }
+
+  // binds the vertex buffer to binding 0 and the index buffer. Only the
+  // index type differs between models, so that is all that needs
+  // comparing before binding again
+  void bind( VkCommandBuffer, VkIndexType );
+  VkBuffer getVertexBuffer() const { return vertices.buffer; }
+  VkBuffer getIndexBuffer() const { return indices.buffer; }
+
+  // whether enough of the free space is scattered in holes between ranges
+  // that defragmenting is worth the wait
+  bool isFragmented() const;
+  // moves every range to the front of new buffers, which frames in flight
+  // don't read from, and waits for the copy, so it's meant for load
+  // boundaries rather than every frame. No batch may hold unflushed copies
+  // into the pool, they would land in the old buffers; this is asserted
+  void defragment();
+
+  GeometryPoolStats getStats() const;
+
+ private:
+  struct Arena {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation allocation;
+    RangeAllocator ranges{ 0 };
+  };
+
+  struct Geometry {
+    VkDeviceSize vertexOffset = 0;
+    VkDeviceSize vertexBytes = 0;
+    uint32_t vertexStride = 0;
+    VkDeviceSize indexOffset = 0;
+    VkDeviceSize indexBytes = 0;
+    uint32_t indexSize = 0;
+    bool used = false;
+  };
+
+  Device& device;
+  Arena vertices;
+  Arena indices;
+  std::vector< Geometry > geometries;
+  // unused entries of geometries, for reuse
+  std::vector< Handle > freeHandles;
+  uint32_t relocations = 0;
+  VkDeviceSize relocatedBytes = 0;
+
+  Arena createArena( VkDeviceSize capacity, VkBufferUsageFlags usage );
+  bool tryAllocate( Geometry& geometry );
+  // copies every range into new buffers of these capacities, packed
+  void relocate( VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity );
+};
+
+}  // namespace lve
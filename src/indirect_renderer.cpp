@@ -0,0 +1,345 @@
+#include "indirect_renderer.hpp"
+
+// std headers
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace lve {
+
+// the shader writes instances as plain floats
+static_assert(
+    sizeof( Model::Instance ) == 9 * sizeof( float ),
+    "cull.comp assumes a tightly packed Model::Instance" );
+
+IndirectRenderer::IndirectRenderer( Device& _device, uint32_t framesInFlight )
+    : device{ _device },
+      objectBuffer{
+          _device, framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT },
+      drawBuffer{
+          _device, framesInFlight,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+              VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT },
+      batchBuffer{
+          _device, framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT },
+      instanceBuffer{
+          _device, framesInFlight,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+              VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT },
+      counterBuffer{
+          _device, framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT },
+      frameSubmitted( framesInFlight, false ),
+      frameObjectCounts( framesInFlight, 0 ) {
+  createDescriptorSetLayout();
+  createPipelineLayout();
+  createDescriptorSets( framesInFlight );
+
+  cullPipeline = std::make_unique< ComputePipeline >(
+      device, "assets/shaders/cull.comp.spv", pipelineLayout );
+}
+
+IndirectRenderer::~IndirectRenderer() {
+  cullPipeline = nullptr;
+
+  // the descriptor sets may still be bound in frames in flight
+  VkDevice owner = device.device();
+  VkDescriptorPool pool = descriptorPool;
+  VkDescriptorSetLayout setLayout = descriptorSetLayout;
+  VkPipelineLayout layout = pipelineLayout;
+  device.deferDestruction( [owner, pool, setLayout, layout]() {
+    vkDestroyDescriptorPool( owner, pool, nullptr );
+    vkDestroyPipelineLayout( owner, layout, nullptr );
+    vkDestroyDescriptorSetLayout( owner, setLayout, nullptr );
+  } );
+}
+
+void IndirectRenderer::createDescriptorSetLayout() {
+  // objects, draw commands, instances, visible count, batch instances
+  std::array< VkDescriptorSetLayoutBinding, 5 > bindings{};
+  for ( uint32_t i = 0; i < bindings.size(); i++ ) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast< uint32_t >( bindings.size() );
+  layoutInfo.pBindings = bindings.data();
+
+  if ( vkCreateDescriptorSetLayout(
+           device.device(), &layoutInfo, nullptr, &descriptorSetLayout ) !=
+       VK_SUCCESS ) {
+    throw std::runtime_error( "failed to create descriptor set layout" );
+  }
+}
+
+void IndirectRenderer::createPipelineLayout() {
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof( CullPushConstants );
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  if ( vkCreatePipelineLayout(
+           device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout ) !=
+       VK_SUCCESS ) {
+    throw std::runtime_error( "failed to create cull pipeline layout" );
+  }
+}
+
+void IndirectRenderer::createDescriptorSets( uint32_t framesInFlight ) {
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = 5 * framesInFlight;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  poolInfo.maxSets = framesInFlight;
+
+  if ( vkCreateDescriptorPool(
+           device.device(), &poolInfo, nullptr, &descriptorPool ) !=
+       VK_SUCCESS ) {
+    throw std::runtime_error( "failed to create descriptor pool" );
+  }
+
+  std::vector< VkDescriptorSetLayout > layouts(
+      framesInFlight, descriptorSetLayout );
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = framesInFlight;
+  allocInfo.pSetLayouts = layouts.data();
+
+  descriptorSets.resize( framesInFlight );
+  if ( vkAllocateDescriptorSets(
+           device.device(), &allocInfo, descriptorSets.data() ) !=
+       VK_SUCCESS ) {
+    throw std::runtime_error( "failed to allocate descriptor sets" );
+  }
+}
+
+void IndirectRenderer::updateDescriptorSet( uint32_t frameIndex ) {
+  std::array< VkDescriptorBufferInfo, 5 > bufferInfos{};
+  bufferInfos[0].buffer = objectBuffer.getBuffer( frameIndex );
+  bufferInfos[1].buffer = drawBuffer.getBuffer( frameIndex );
+  bufferInfos[2].buffer = instanceBuffer.getBuffer( frameIndex );
+  bufferInfos[3].buffer = counterBuffer.getBuffer( frameIndex );
+  bufferInfos[4].buffer = batchBuffer.getBuffer( frameIndex );
+
+  std::array< VkWriteDescriptorSet, 5 > writes{};
+  for ( uint32_t i = 0; i < writes.size(); i++ ) {
+    bufferInfos[i].offset = 0;
+    bufferInfos[i].range = VK_WHOLE_SIZE;
+
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = descriptorSets[frameIndex];
+    writes[i].dstBinding = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo = &bufferInfos[i];
+  }
+
+  vkUpdateDescriptorSets(
+      device.device(), static_cast< uint32_t >( writes.size() ),
+      writes.data(), 0, nullptr );
+}
+
+void IndirectRenderer::cull(
+    VkCommandBuffer commandBuffer, uint32_t frameIndex,
+    const std::vector< GameObject >& gameObjects,
+    const std::vector< uint32_t >& objectBatches,
+    const std::vector< DrawBatch >& batches, float alpha ) {
+  // the previous frame in this slot has completed, its count is final
+  auto* counter = static_cast< uint32_t* >(
+      counterBuffer.getMappedMemory( frameIndex ) );
+  if ( frameSubmitted[frameIndex] ) {
+    visibleCount = *counter;
+    culledCount = frameObjectCounts[frameIndex] - visibleCount;
+  }
+
+  uint32_t objectCount = static_cast< uint32_t >( gameObjects.size() );
+
+  // buffers are never empty, so the descriptors are always valid
+  bool resized = false;
+  resized |= objectBuffer.reserve(
+      frameIndex, std::max( objectCount, 1u ) * sizeof( GpuObject ) );
+  resized |= drawBuffer.reserve(
+      frameIndex,
+      std::max( batches.size(), size_t( 1 ) ) *
+          sizeof( VkDrawIndexedIndirectCommand ) );
+  resized |= batchBuffer.reserve(
+      frameIndex,
+      std::max( batches.size(), size_t( 1 ) ) * sizeof( uint32_t ) );
+  resized |= instanceBuffer.reserve(
+      frameIndex, std::max( objectCount, 1u ) * sizeof( Model::Instance ) );
+  resized |= counterBuffer.reserve( frameIndex, sizeof( uint32_t ) );
+  if ( resized ) {
+    updateDescriptorSet( frameIndex );
+    counter = static_cast< uint32_t* >(
+        counterBuffer.getMappedMemory( frameIndex ) );
+  }
+  *counter = 0;
+
+  auto* objects =
+      static_cast< GpuObject* >( objectBuffer.getMappedMemory( frameIndex ) );
+  for ( uint32_t i = 0; i < objectCount; i++ ) {
+    const GameObject& object = gameObjects[i];
+    Transform2dComponent renderTransform = object.getRenderTransform( alpha );
+    glm::mat2 transform = renderTransform.mat2();
+    glm::vec2 scale = glm::abs( renderTransform.scale );
+    glm::vec2 offset = renderTransform.translation;
+    // the model that is drawn, which may stand in for the object's own
+    const Model& model = *batches[objectBatches[i]].model;
+    model.dequantize( transform, offset );
+
+    GpuObject& gpuObject = objects[i];
+    gpuObject.transform = {
+      transform[0][0], transform[0][1], transform[1][0], transform[1][1] };
+    gpuObject.offset = offset;
+    // the shader culls around the offset, which dequantizing may have moved
+    // away from the model's origin
+    gpuObject.radius =
+        model.getBoundingRadius() * glm::max( scale.x, scale.y ) +
+        glm::length( offset - renderTransform.translation );
+    gpuObject.batch = objectBatches[i];
+    gpuObject.color = glm::vec4( object.color, 1.f );
+  }
+
+  // instances are counted up by the shader. A non-zero firstInstance in an
+  // indirect draw needs drawIndirectFirstInstance; without it draw() binds
+  // each batch's instances at their offset instead
+  auto* draws = static_cast< VkDrawIndexedIndirectCommand* >(
+      drawBuffer.getMappedMemory( frameIndex ) );
+  auto* firstInstances =
+      static_cast< uint32_t* >( batchBuffer.getMappedMemory( frameIndex ) );
+  bool firstInstance = device.hasDrawIndirectFirstInstance();
+  batchModels.clear();
+  batchFirstInstances.clear();
+  for ( uint32_t i = 0; i < batches.size(); i++ ) {
+    draws[i] = batches[i].model->getDrawCommand();
+    draws[i].instanceCount = 0;
+    draws[i].firstInstance = firstInstance ? batches[i].firstInstance : 0;
+    firstInstances[i] = batches[i].firstInstance;
+    batchModels.push_back( batches[i].model );
+    batchFirstInstances.push_back( batches[i].firstInstance );
+  }
+
+  uploadedBytes = objectCount * sizeof( GpuObject ) +
+                  batches.size() * ( sizeof( VkDrawIndexedIndirectCommand ) +
+                                     sizeof( uint32_t ) ) +
+                  sizeof( uint32_t );
+
+  frameSubmitted[frameIndex] = true;
+  frameObjectCounts[frameIndex] = objectCount;
+  if ( objectCount == 0 ) return;
+
+  cullPipeline->bind( commandBuffer );
+  vkCmdBindDescriptorSets(
+      commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+      &descriptorSets[frameIndex], 0, nullptr );
+
+  // objects are in normalized device coordinates already
+  CullPushConstants push{};
+  push.viewMin = { -1.f, -1.f };
+  push.viewMax = { 1.f, 1.f };
+  push.objectCount = objectCount;
+  vkCmdPushConstants(
+      commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+      sizeof( CullPushConstants ), &push );
+
+  vkCmdDispatch(
+      commandBuffer, ( objectCount + WORKGROUP_SIZE - 1 ) / WORKGROUP_SIZE, 1,
+      1 );
+
+  // the draw commands and instances are read by the draws in the render
+  // pass, the visible count by the host once the frame's fence signaled
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                          VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                          VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+          VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+      0, 1, &barrier, 0, nullptr, 0, nullptr );
+}
+
+void IndirectRenderer::draw(
+    VkCommandBuffer commandBuffer, uint32_t frameIndex,
+    const std::vector< Pipeline* >& pipelines ) {
+  drawCalls = 0;
+  if ( batchModels.empty() ) return;
+
+  VkBuffer instances = instanceBuffer.getBuffer( frameIndex );
+  VkDeviceSize offset = 0;
+  bool firstInstance = device.hasDrawIndirectFirstInstance();
+  if ( firstInstance )
+    vkCmdBindVertexBuffers( commandBuffer, 1, 1, &instances, &offset );
+
+  // every model is in the geometry pool, so batches that share a pipeline
+  // and an index type only differ in their draw command and go out in one
+  // multi draw; how many instances are drawn is up to the GPU. Without
+  // multiDrawIndirect each still needs a call, but no bind, and without
+  // drawIndirectFirstInstance each needs its instances bound
+  uint32_t maxDrawCount =
+      device.hasMultiDrawIndirect() && firstInstance
+          ? device.properties.limits.maxDrawIndirectCount
+          : 1;
+  Pipeline* boundPipeline = nullptr;
+  VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+  for ( uint32_t i = 0; i < batchModels.size(); ) {
+    const Model& model = *batchModels[i];
+    Pipeline* pipeline =
+        pipelines[static_cast< uint32_t >( model.getVertexFormat() )];
+    if ( pipeline != boundPipeline ) {
+      pipeline->bind( commandBuffer );
+      boundPipeline = pipeline;
+    }
+    if ( model.getIndexType() != boundIndexType ) {
+      batchModels[i]->bind( commandBuffer );
+      boundIndexType = model.getIndexType();
+    }
+
+    uint32_t drawCount = 1;
+    while ( i + drawCount < batchModels.size() && drawCount < maxDrawCount &&
+            batchModels[i + drawCount]->getVertexFormat() ==
+                model.getVertexFormat() &&
+            batchModels[i + drawCount]->getIndexType() ==
+                model.getIndexType() )
+      drawCount++;
+
+    if ( !firstInstance ) {
+      offset = batchFirstInstances[i] * sizeof( Model::Instance );
+      vkCmdBindVertexBuffers( commandBuffer, 1, 1, &instances, &offset );
+    }
+    vkCmdDrawIndexedIndirect(
+        commandBuffer, drawBuffer.getBuffer( frameIndex ),
+        i * sizeof( VkDrawIndexedIndirectCommand ), drawCount,
+        sizeof( VkDrawIndexedIndirectCommand ) );
+    drawCalls++;
+    i += drawCount;
+  }
+}
+
+}  // namespace lve
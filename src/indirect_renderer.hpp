@@ -0,0 +1,110 @@
+#pragma once
+
+#include "compute_pipeline.hpp"
+#include "device.hpp"
+#include "game_object.hpp"
+#include "per_frame_buffer.hpp"
+#include "pipeline.hpp"
+
+// std lib headers
+#include <memory>
+#include <vector>
+
+namespace lve {
+
+// objects that share a model; their instances are contiguous in the
+// instance buffer
+struct DrawBatch {
+  Model* model;
+  uint32_t firstInstance;
+  uint32_t instanceCount;
+};
+
+// GPU driven drawing: every object goes into a storage buffer, a compute
+// shader culls them against the view and appends the visible ones to the
+// instance buffer of their model, bumping instanceCount of that model's
+// indirect draw command. The CPU only writes object data; the number of
+// draw calls it records depends on the number of vertex formats and index
+// types in use, or of models without multiDrawIndirect, not on objects
+class IndirectRenderer {
+ public:
+  static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+  IndirectRenderer( Device& device, uint32_t framesInFlight );
+  ~IndirectRenderer();
+  IndirectRenderer( const IndirectRenderer& ) = delete;
+  IndirectRenderer& operator=( const IndirectRenderer& ) = delete;
+
+  // writes the objects of this frame and one empty draw command per batch,
+  // and records the culling dispatch. Must be recorded outside of a render
+  // pass. objectBatches[i] is the index of gameObjects[i]'s batch, alpha
+  // blends between the objects' previous and current transforms
+  void cull(
+      VkCommandBuffer commandBuffer, uint32_t frameIndex,
+      const std::vector< GameObject >& gameObjects,
+      const std::vector< uint32_t >& objectBatches,
+      const std::vector< DrawBatch >& batches, float alpha );
+
+  // records the draws of the batches passed to the last cull. pipelines
+  // holds a pipeline with the instanced Model::Vertex layout for every
+  // vertex format, indexed by it; each batch is drawn with its model's
+  void draw(
+      VkCommandBuffer commandBuffer, uint32_t frameIndex,
+      const std::vector< Pipeline* >& pipelines );
+
+  // read back from the last frame that has completed in a slot
+  uint32_t getVisibleCount() const { return visibleCount; }
+  uint32_t getCulledCount() const { return culledCount; }
+  // bytes the CPU wrote in the last cull
+  VkDeviceSize getUploadedBytes() const { return uploadedBytes; }
+  // vkCmdDrawIndexedIndirect calls in the last draw
+  uint32_t getDrawCallCount() const { return drawCalls; }
+
+ private:
+  struct GpuObject {
+    // columns of the 2x2 transform
+    glm::vec4 transform;
+    glm::vec2 offset;
+    float radius;
+    uint32_t batch;
+    glm::vec4 color;
+  };
+
+  struct CullPushConstants {
+    glm::vec2 viewMin;
+    glm::vec2 viewMax;
+    uint32_t objectCount;
+  };
+
+  void createDescriptorSetLayout();
+  void createPipelineLayout();
+  void createDescriptorSets( uint32_t framesInFlight );
+  void updateDescriptorSet( uint32_t frameIndex );
+
+  Device& device;
+
+  VkDescriptorSetLayout descriptorSetLayout;
+  VkPipelineLayout pipelineLayout;
+  VkDescriptorPool descriptorPool;
+  std::vector< VkDescriptorSet > descriptorSets;
+  std::unique_ptr< ComputePipeline > cullPipeline;
+
+  PerFrameBuffer objectBuffer;
+  PerFrameBuffer drawBuffer;
+  // first instance of every batch, for the shader
+  PerFrameBuffer batchBuffer;
+  PerFrameBuffer instanceBuffer;
+  // number of visible objects, written by the shader
+  PerFrameBuffer counterBuffer;
+
+  std::vector< bool > frameSubmitted;
+  std::vector< uint32_t > frameObjectCounts;
+  std::vector< Model* > batchModels;
+  std::vector< uint32_t > batchFirstInstances;
+  uint32_t visibleCount = 0;
+  uint32_t culledCount = 0;
+  VkDeviceSize uploadedBytes = 0;
+  uint32_t drawCalls = 0;
+};
+
+}  // namespace lve
@@ -1,11 +1,80 @@
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 
 #include "first_app.hpp"
 
+static bool parsePresentMode( const char* name, VkPresentModeKHR& mode ) {
+  if ( strcmp( name, "fifo" ) == 0 ) {
+    mode = VK_PRESENT_MODE_FIFO_KHR;
+  } else if ( strcmp( name, "fifo-relaxed" ) == 0 ) {
+    mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+  } else if ( strcmp( name, "mailbox" ) == 0 ) {
+    mode = VK_PRESENT_MODE_MAILBOX_KHR;
+  } else if ( strcmp( name, "immediate" ) == 0 ) {
+    mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 int main( int argc, char** argv ) {
-  lve::FirstApp app{};
+  lve::AppConfig config{};
+
+  // --headless renders offscreen, --frames N stops after N frames,
+  // --wait-idle serializes CPU and GPU after every frame for comparison,
+  // --per-object draws every object on its own instead of instanced,
+  // --indirect culls on the GPU and draws indirect, --present-mode and
+  // --images pick the initial swap chain settings, --vertex-format how the
+  // models store their vertices, --mesh draws a mesh file (repeatable),
+  // --stream loads the models in the background, --dynamic draws geometry
+  // that is generated every frame on top
+  for ( int i = 1; i < argc; i++ ) {
+    if ( strcmp( argv[i], "--headless" ) == 0 ) {
+      config.headless = true;
+    } else if ( strcmp( argv[i], "--wait-idle" ) == 0 ) {
+      config.waitIdleEachFrame = true;
+    } else if ( strcmp( argv[i], "--per-object" ) == 0 ) {
+      config.renderMode = lve::RenderMode::PerObject;
+    } else if ( strcmp( argv[i], "--indirect" ) == 0 ) {
+      config.renderMode = lve::RenderMode::Indirect;
+    } else if ( strcmp( argv[i], "--frames" ) == 0 && i + 1 < argc ) {
+      config.frameCount = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--present-mode" ) == 0 && i + 1 < argc &&
+                parsePresentMode(
+                    argv[i + 1], config.swapChainSettings.presentMode ) ) {
+      i++;
+    } else if ( strcmp( argv[i], "--images" ) == 0 && i + 1 < argc ) {
+      config.swapChainSettings.imageCount =
+          static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--vertex-format" ) == 0 && i + 1 < argc &&
+                lve::parseVertexFormat( argv[i + 1], config.vertexFormat ) ) {
+      i++;
+    } else if ( strcmp( argv[i], "--stream" ) == 0 ) {
+      config.streamModels = true;
+    } else if ( strcmp( argv[i], "--dynamic" ) == 0 ) {
+      config.dynamicGeometry = true;
+    } else if ( strcmp( argv[i], "--mesh" ) == 0 && i + 1 < argc ) {
+      config.meshPaths.push_back( argv[++i] );
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--headless] [--frames N] [--wait-idle]"
+                   " [--per-object | --indirect]"
+                   " [--present-mode fifo|fifo-relaxed|mailbox|immediate]"
+                   " [--images N] [--vertex-format float|snorm16|half]"
+                   " [--mesh PATH]... [--stream] [--dynamic]"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // without a window there is nothing to close, so run a fixed number of
+  // frames unless told otherwise
+  if ( config.headless && config.frameCount == 0 ) config.frameCount = 1000;
+
+  lve::FirstApp app{ config };
 
   try {
     app.run();
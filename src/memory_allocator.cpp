@@ -0,0 +1,200 @@
+#include "memory_allocator.hpp"
+
+// std headers
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace lve {
+
+MemoryAllocator::MemoryAllocator(
+    VkDevice _device, VkPhysicalDevice physicalDevice )
+    : device{ _device } {
+  vkGetPhysicalDeviceMemoryProperties( physicalDevice, &memoryProperties );
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+  maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+  pools.resize( memoryProperties.memoryTypeCount * 2 );
+  for ( uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++ ) {
+    // small heaps (e.g. the 256MB BAR heap on discrete cards) get smaller
+    // blocks so a single block can't eat the whole heap
+    uint32_t heapIndex = memoryProperties.memoryTypes[i].heapIndex;
+    VkDeviceSize heapSize = memoryProperties.memoryHeaps[heapIndex].size;
+    VkDeviceSize blockSize = std::min( DEFAULT_BLOCK_SIZE, heapSize / 8 );
+
+    pools[i * 2].blockSize = blockSize;
+    pools[i * 2 + 1].blockSize = blockSize;
+  }
+}
+
+MemoryAllocator::~MemoryAllocator() {
+  for ( auto& pool: pools ) {
+    for ( auto& block: pool.blocks ) {
+      if ( block == nullptr ) continue;
+
+      assert(
+          block->allocationCount == 0 &&
+          "Memory allocator destroyed while memory is still in use" );
+
+      // freeing mapped memory implicitly unmaps it
+      vkFreeMemory( device, block->memory, nullptr );
+    }
+  }
+}
+
+uint32_t MemoryAllocator::findMemoryType(
+    uint32_t typeFilter, VkMemoryPropertyFlags properties ) {
+  for ( uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++ ) {
+    if ( ( typeFilter & ( 1 << i ) ) &&
+         ( memoryProperties.memoryTypes[i].propertyFlags & properties ) ==
+             properties ) {
+      return i;
+    }
+  }
+
+  throw std::runtime_error( "failed to find suitable memory type!" );
+}
+
+uint32_t MemoryAllocator::createBlock(
+    uint32_t poolIndex, VkDeviceSize size ) {
+  if ( deviceAllocationCount >= maxAllocationCount ) {
+    throw std::runtime_error( "exceeded maxMemoryAllocationCount!" );
+  }
+
+  uint32_t memoryType = poolIndex / 2;
+
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+
+  VkDeviceMemory memory;
+  if ( vkAllocateMemory( device, &allocInfo, nullptr, &memory ) !=
+       VK_SUCCESS ) {
+    throw std::runtime_error( "failed to allocate memory block!" );
+  }
+  deviceAllocationCount++;
+
+  // host visible blocks are mapped once and stay mapped; a VkDeviceMemory can
+  // only be mapped once at a time, so sub-allocations could not map
+  // themselves individually anyway
+  void* mapped = nullptr;
+  if ( memoryProperties.memoryTypes[memoryType].propertyFlags &
+       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ) {
+    if ( vkMapMemory( device, memory, 0, VK_WHOLE_SIZE, 0, &mapped ) !=
+         VK_SUCCESS ) {
+      throw std::runtime_error( "failed to map memory block!" );
+    }
+  }
+
+  auto block = std::unique_ptr< Block >(
+      new Block{ memory, mapped, RangeAllocator{ size }, 0 } );
+
+  // reuse a slot of a previously released block so that block indices held
+  // by live allocations stay valid
+  auto& blocks = pools[poolIndex].blocks;
+  for ( uint32_t i = 0; i < blocks.size(); i++ ) {
+    if ( blocks[i] == nullptr ) {
+      blocks[i] = std::move( block );
+      return i;
+    }
+  }
+
+  blocks.push_back( std::move( block ) );
+  return static_cast< uint32_t >( blocks.size() - 1 );
+}
+
+Allocation MemoryAllocator::allocate(
+    const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+    bool linear ) {
+  uint32_t memoryType =
+      findMemoryType( requirements.memoryTypeBits, properties );
+  uint32_t poolIndex = memoryType * 2 + ( linear ? 0 : 1 );
+  Pool& pool = pools[poolIndex];
+
+  Allocation allocation{};
+  allocation.poolIndex = poolIndex;
+  allocation.size = requirements.size;
+
+  uint32_t blockIndex = 0;
+  uint64_t offset = 0;
+  bool found = false;
+  for ( ; blockIndex < pool.blocks.size(); blockIndex++ ) {
+    auto& block = pool.blocks[blockIndex];
+    if ( block != nullptr &&
+         block->ranges.allocate(
+             requirements.size, requirements.alignment, offset ) ) {
+      found = true;
+      break;
+    }
+  }
+
+  if ( !found ) {
+    // anything larger than a block gets a block of its own
+    blockIndex = createBlock(
+        poolIndex, std::max( pool.blockSize, requirements.size ) );
+    pool.blocks[blockIndex]->ranges.allocate(
+        requirements.size, requirements.alignment, offset );
+  }
+
+  Block& block = *pool.blocks[blockIndex];
+  block.allocationCount++;
+
+  allocation.memory = block.memory;
+  allocation.offset = offset;
+  allocation.blockIndex = blockIndex;
+  if ( block.mapped != nullptr ) {
+    allocation.mapped = static_cast< char* >( block.mapped ) + offset;
+  }
+
+  return allocation;
+}
+
+void MemoryAllocator::free( Allocation& allocation ) {
+  if ( allocation.memory == VK_NULL_HANDLE ) return;
+
+  Pool& pool = pools[allocation.poolIndex];
+  auto& block = pool.blocks[allocation.blockIndex];
+  assert( block != nullptr && block->memory == allocation.memory );
+
+  block->ranges.free( allocation.offset, allocation.size );
+  block->allocationCount--;
+
+  // give empty blocks back to the driver, but keep one around per pool so
+  // that a load/unload cycle doesn't hit vkAllocateMemory every time
+  if ( block->allocationCount == 0 ) {
+    bool otherBlocks = std::any_of(
+        pool.blocks.begin(), pool.blocks.end(),
+        [&]( const std::unique_ptr< Block >& other ) {
+          return other != nullptr && other != block;
+        } );
+    if ( otherBlocks || block->ranges.capacity() > pool.blockSize ) {
+      vkFreeMemory( device, block->memory, nullptr );
+      deviceAllocationCount--;
+      block = nullptr;
+    }
+  }
+
+  allocation = Allocation{};
+}
+
+MemoryStats MemoryAllocator::getStats() {
+  MemoryStats stats{};
+  for ( auto& pool: pools ) {
+    for ( auto& block: pool.blocks ) {
+      if ( block == nullptr ) continue;
+
+      stats.blockCount++;
+      stats.allocationCount += block->allocationCount;
+      stats.reservedBytes += block->ranges.capacity();
+      stats.usedBytes += block->ranges.usedSize();
+      stats.largestFreeRange =
+          std::max( stats.largestFreeRange, block->ranges.largestFreeRange() );
+    }
+  }
+  return stats;
+}
+
+}  // namespace lve
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// std lib headers
+#include <memory>
+#include <vector>
+
+#include "range_allocator.hpp"
+
+namespace lve {
+
+// a piece of a larger VkDeviceMemory block. Buffers and images are bound to
+// `memory` at `offset`; if the memory type is host visible, `mapped` points
+// straight at the first byte of the allocation since blocks stay mapped for
+// their whole lifetime.
+struct Allocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  void* mapped = nullptr;
+
+  uint32_t poolIndex = 0;
+  uint32_t blockIndex = 0;
+};
+
+struct MemoryStats {
+  uint32_t blockCount = 0;
+  uint32_t allocationCount = 0;
+  VkDeviceSize reservedBytes = 0;
+  VkDeviceSize usedBytes = 0;
+  VkDeviceSize largestFreeRange = 0;
+};
+
+// instead of calling vkAllocateMemory for every buffer and image, we reserve
+// large blocks of memory per memory type and sub-allocate from them. Drivers
+// only guarantee maxMemoryAllocationCount (often 4096) allocations, and each
+// one of them is slow.
+class MemoryAllocator {
+ public:
+  static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+  MemoryAllocator( VkDevice, VkPhysicalDevice );
+  ~MemoryAllocator();
+  MemoryAllocator( const MemoryAllocator& ) = delete;
+  MemoryAllocator& operator=( const MemoryAllocator& ) = delete;
+
+  // linear is true for buffers and linearly tiled images, false for optimally
+  // tiled images; the two are kept in separate blocks so we never have to
+  // care about bufferImageGranularity
+  Allocation allocate(
+      const VkMemoryRequirements&, VkMemoryPropertyFlags, bool linear );
+  void free( Allocation& );
+
+  MemoryStats getStats();
+
+ private:
+  struct Block {
+    VkDeviceMemory memory;
+    void* mapped;
+    RangeAllocator ranges;
+    uint32_t allocationCount;
+  };
+
+  struct Pool {
+    VkDeviceSize blockSize;
+    std::vector< std::unique_ptr< Block > > blocks;
+  };
+
+  VkDevice device;
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  uint32_t maxAllocationCount;
+  uint32_t deviceAllocationCount = 0;
+
+  // one pool per memory type and linear/optimal resource kind
+  std::vector< Pool > pools;
+
+  uint32_t findMemoryType( uint32_t, VkMemoryPropertyFlags );
+  uint32_t createBlock( uint32_t, VkDeviceSize );
+};
+
+}  // namespace lve
@@ -0,0 +1,80 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "mesh_file.hpp"
+#include "sierpinski.hpp"
+
+// writes generated sierpinski meshes as mesh files, for the app and the
+// benchmark to load with --mesh. The triangles are picked like the ones of
+// the benchmark scene
+int main( int argc, char** argv ) {
+  uint32_t count = 4;
+  uint32_t depth = 3;
+  uint32_t seed = 1;
+  lve::VertexFormat format = lve::VertexFormat::Float32;
+  std::string prefix = "sierpinski";
+
+  for ( int i = 1; i < argc; i++ ) {
+    bool hasValue = i + 1 < argc;
+    if ( strcmp( argv[i], "--count" ) == 0 && hasValue ) {
+      count = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--depth" ) == 0 && hasValue ) {
+      depth = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--seed" ) == 0 && hasValue ) {
+      seed = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--vertex-format" ) == 0 && hasValue &&
+                lve::parseVertexFormat( argv[i + 1], format ) ) {
+      i++;
+    } else if ( strcmp( argv[i], "--output" ) == 0 && hasValue ) {
+      prefix = argv[++i];
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--count N] [--depth D] [--seed S]"
+                   " [--vertex-format float|snorm16|half]"
+                   " [--output PREFIX]"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if ( depth > lve::SIERPINSKI_MAX_DEPTH ) {
+    std::cerr << "depth is at most " << int( lve::SIERPINSKI_MAX_DEPTH )
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::mt19937 random{ seed };
+  auto uniform = [&random]( float min, float max ) {
+    return std::uniform_real_distribution< float >{ min, max }( random );
+  };
+
+  try {
+    for ( uint32_t i = 0; i < count; i++ ) {
+      std::vector< lve::Model::Triangle > initialTriangle{
+        { { { uniform( -0.5f, 0.5f ), uniform( -0.5f, 0.f ) },
+            { 0.f, 0.5f, 0.5f } },
+          { { uniform( 0.f, 0.5f ), uniform( 0.f, 0.5f ) }, { 0.f, 1.f, 0.f } },
+          { { uniform( -0.5f, 0.f ), uniform( 0.f, 0.5f ) },
+            { 0.f, 0.f, 1.f } } } };
+      lve::Model::Builder builder{};
+      builder.weld( lve::sierpinski(
+          static_cast< unsigned char >( depth ), initialTriangle ) );
+      builder.format = format;
+
+      std::string path = prefix + "_" + std::to_string( i ) + ".lvem";
+      lve::writeMeshFile( path, builder );
+      std::cout << "wrote " << path << ": " << builder.vertices.size()
+                << " vertices, " << builder.indices.size() << " indices"
+                << std::endl;
+    }
+  } catch ( const std::exception& e ) {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+#include "mesh_file.hpp"
+
+// std headers
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lve {
+
+static uint64_t alignUp( uint64_t value ) {
+  uint64_t alignment = MeshFileHeader::ALIGNMENT;
+  return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+MeshFile::MeshFile( const std::string& _path ) : path{ _path } {
+  int fd = open( path.c_str(), O_RDONLY );
+  if ( fd < 0 ) throw std::runtime_error( "failed to open " + path );
+
+  struct stat info;
+  if ( fstat( fd, &info ) != 0 ) {
+    close( fd );
+    throw std::runtime_error( "failed to stat " + path );
+  }
+  size = static_cast< size_t >( info.st_size );
+  if ( size < sizeof( MeshFileHeader ) ) {
+    close( fd );
+    throw std::runtime_error( path + " is too small to be a mesh file" );
+  }
+
+  // the mapping keeps the file alive on its own
+  void* mapped = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if ( mapped == MAP_FAILED )
+    throw std::runtime_error( "failed to map " + path );
+  data = static_cast< const unsigned char* >( mapped );
+
+  // the whole file is about to be copied front to back
+  madvise( mapped, size, MADV_SEQUENTIAL );
+  madvise( mapped, size, MADV_WILLNEED );
+
+  try {
+    validate();
+  } catch ( ... ) {
+    munmap( mapped, size );
+    throw;
+  }
+}
+
+MeshFile::~MeshFile() {
+  munmap( const_cast< unsigned char* >( data ), size );
+}
+
+void MeshFile::validate() const {
+  const auto* header = reinterpret_cast< const MeshFileHeader* >( data );
+  if ( header->magic != MeshFileHeader::MAGIC )
+    throw std::runtime_error( path + " is not a mesh file" );
+  if ( header->version != MeshFileHeader::VERSION )
+    throw std::runtime_error(
+        path + " has mesh file version " +
+        std::to_string( header->version ) + ", expected " +
+        std::to_string( MeshFileHeader::VERSION ) );
+
+  if ( header->vertexFormat >= VERTEX_FORMAT_COUNT )
+    throw std::runtime_error( path + " has an unknown vertex format" );
+  size_t stride =
+      static_cast< VertexFormat >( header->vertexFormat ) ==
+              VertexFormat::Float32
+          ? sizeof( Model::Vertex )
+          : sizeof( Model::PackedVertex );
+  if ( header->indexSize != sizeof( uint16_t ) &&
+       header->indexSize != sizeof( uint32_t ) )
+    throw std::runtime_error( path + " has an unknown index size" );
+  if ( header->vertexCount < 3 || header->indexCount < 3 )
+    throw std::runtime_error( path + " holds no triangles" );
+
+  // everything after the header has to be where the header says, so that
+  // nothing is read past the end of the mapping
+  if ( header->vertexBytes != uint64_t( header->vertexCount ) * stride ||
+       header->indexBytes !=
+           uint64_t( header->indexCount ) * header->indexSize ||
+       header->vertexOffset < sizeof( MeshFileHeader ) ||
+       header->vertexOffset % MeshFileHeader::ALIGNMENT != 0 ||
+       header->indexOffset % MeshFileHeader::ALIGNMENT != 0 ||
+       header->vertexOffset > size ||
+       header->vertexBytes > size - header->vertexOffset ||
+       header->indexOffset > size ||
+       header->indexBytes > size - header->indexOffset )
+    throw std::runtime_error( path + " is truncated or corrupt" );
+
+  // an index past the vertices would have the GPU fetch outside of them.
+  // The blob is aligned, so it can be read in place
+  uint32_t maxIndex = 0;
+  const unsigned char* indices = data + header->indexOffset;
+  if ( header->indexSize == sizeof( uint16_t ) ) {
+    const auto* index = reinterpret_cast< const uint16_t* >( indices );
+    for ( uint32_t i = 0; i < header->indexCount; i++ )
+      maxIndex = std::max< uint32_t >( maxIndex, index[i] );
+  } else {
+    const auto* index = reinterpret_cast< const uint32_t* >( indices );
+    for ( uint32_t i = 0; i < header->indexCount; i++ )
+      maxIndex = std::max( maxIndex, index[i] );
+  }
+  if ( maxIndex >= header->vertexCount )
+    throw std::runtime_error(
+        path + " has index " + std::to_string( maxIndex ) + " past its " +
+        std::to_string( header->vertexCount ) + " vertices" );
+}
+
+MeshView MeshFile::getView() const {
+  const auto* header = reinterpret_cast< const MeshFileHeader* >( data );
+  return { header, data + header->vertexOffset, data + header->indexOffset };
+}
+
+void writeMeshFile( const std::string& path, const Model::Builder& builder ) {
+  const std::vector< Model::Vertex >& vertices = builder.vertices;
+  const std::vector< uint32_t >& indices = builder.indices;
+  if ( vertices.size() < 3 || indices.size() < 3 )
+    throw std::runtime_error( "no triangles to write to " + path );
+
+  MeshFileHeader header{};
+  header.vertexFormat = static_cast< uint32_t >( builder.format );
+  header.vertexCount = static_cast< uint32_t >( vertices.size() );
+  header.indexCount = static_cast< uint32_t >( indices.size() );
+  header.inputVertexCount =
+      builder.inputVertexCount > 0 ? builder.inputVertexCount
+                                   : header.indexCount;
+  header.boundsMin = vertices[0].position;
+  header.boundsMax = vertices[0].position;
+  for ( const auto& vertex: vertices ) {
+    header.boundsMin = glm::min( header.boundsMin, vertex.position );
+    header.boundsMax = glm::max( header.boundsMax, vertex.position );
+    header.boundingRadius =
+        glm::max( header.boundingRadius, glm::length( vertex.position ) );
+  }
+  header.acmr = Model::averageCacheMissRatio( indices );
+
+  // the blobs are written exactly as Model would upload them
+  const void* vertexData = vertices.data();
+  header.vertexBytes = vertices.size() * sizeof( Model::Vertex );
+  std::vector< Model::PackedVertex > packed;
+  if ( builder.format != VertexFormat::Float32 ) {
+    Model::Quantization quantization;
+    packed =
+        Model::packVertices( vertices, builder.format, quantization );
+    vertexData = packed.data();
+    header.vertexBytes = packed.size() * sizeof( Model::PackedVertex );
+    header.positionScale = quantization.positionScale;
+    header.positionOffset = quantization.positionOffset;
+    header.maxPositionError = quantization.maxPositionError;
+    header.positionErrorBound = quantization.positionErrorBound;
+    header.maxColorError = quantization.maxColorError;
+    header.colorErrorBound = quantization.colorErrorBound;
+  }
+
+  const void* indexData = indices.data();
+  header.indexSize = sizeof( uint32_t );
+  std::vector< uint16_t > shortIndices;
+  if ( vertices.size() <= std::numeric_limits< uint16_t >::max() + 1u ) {
+    shortIndices.assign( indices.begin(), indices.end() );
+    indexData = shortIndices.data();
+    header.indexSize = sizeof( uint16_t );
+  }
+  header.indexBytes = uint64_t( header.indexCount ) * header.indexSize;
+
+  header.vertexOffset = alignUp( sizeof( MeshFileHeader ) );
+  header.indexOffset = alignUp( header.vertexOffset + header.vertexBytes );
+
+  std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+  if ( !file ) throw std::runtime_error( "failed to write " + path );
+
+  const char padding[MeshFileHeader::ALIGNMENT] = {};
+  file.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+  file.write( padding, header.vertexOffset - sizeof( header ) );
+  file.write(
+      static_cast< const char* >( vertexData ),
+      static_cast< std::streamsize >( header.vertexBytes ) );
+  file.write(
+      padding, header.indexOffset - header.vertexOffset - header.vertexBytes );
+  file.write(
+      static_cast< const char* >( indexData ),
+      static_cast< std::streamsize >( header.indexBytes ) );
+  if ( !file ) throw std::runtime_error( "failed to write " + path );
+}
+
+}  // namespace lve
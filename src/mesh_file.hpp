@@ -0,0 +1,85 @@
+#pragma once
+
+#include "model.hpp"
+
+// std lib headers
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace lve {
+
+// a mesh file is this header followed by the vertex and the index blob, both
+// in the format the GPU reads them in, so that loading is a copy from the
+// file into staging memory. Everything is little endian
+struct MeshFileHeader {
+  static constexpr uint32_t MAGIC = 0x4d45564c;  // "LVEM"
+  static constexpr uint32_t VERSION = 1;
+  // of both blobs within the file
+  static constexpr uint64_t ALIGNMENT = 64;
+
+  uint32_t magic = MAGIC;
+  uint32_t version = VERSION;
+  // a VertexFormat; the blob holds Model::Vertex or Model::PackedVertex
+  uint32_t vertexFormat = 0;
+  uint32_t vertexCount = 0;
+  uint32_t indexCount = 0;
+  // 2 or 4
+  uint32_t indexSize = 0;
+  // before welding, for the stats
+  uint32_t inputVertexCount = 0;
+  float boundingRadius = 0.f;
+  glm::vec2 boundsMin{ 0.f };
+  glm::vec2 boundsMax{ 0.f };
+  // undoes the normalization of the compact formats, see Model::dequantize
+  glm::vec2 positionScale{ 1.f };
+  glm::vec2 positionOffset{ 0.f };
+  float maxPositionError = 0.f;
+  float positionErrorBound = 0.f;
+  float maxColorError = 0.f;
+  float colorErrorBound = 0.f;
+  double acmr = 0.0;
+  uint64_t vertexOffset = 0;
+  uint64_t vertexBytes = 0;
+  uint64_t indexOffset = 0;
+  uint64_t indexBytes = 0;
+  uint64_t reserved = 0;
+};
+static_assert(
+    sizeof( MeshFileHeader ) == 128, "mesh file header layout changed" );
+
+// a mesh as it lies in memory, without owning any of it
+struct MeshView {
+  const MeshFileHeader* header = nullptr;
+  const void* vertices = nullptr;
+  const void* indices = nullptr;
+};
+
+// a mesh file mapped into memory read only. Pages are only read in when the
+// data is copied out, straight from the page cache, without going through a
+// buffer of our own; only the indices are read once up front, to check them
+class MeshFile {
+ public:
+  // throws if the file can't be mapped or isn't a valid mesh file
+  explicit MeshFile( const std::string& path );
+  ~MeshFile();
+  MeshFile( const MeshFile& ) = delete;
+  MeshFile& operator=( const MeshFile& ) = delete;
+
+  MeshView getView() const;
+  size_t getSize() const { return size; }
+
+ private:
+  std::string path;
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+
+  void validate() const;
+};
+
+// the builder has to be indexed already, e.g. by Model::Builder::weld;
+// compact formats are packed on the way out. Throws if the file can't be
+// written
+void writeMeshFile( const std::string& path, const Model::Builder& builder );
+
+}  // namespace lve
@@ -1,69 +1,373 @@
 #include "model.hpp"
 
+#include "mesh_file.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+// std
+#include <atomic>
 #include <cassert>
 #include <cstring>
+#include <deque>
+#include <limits>
+#include <unordered_map>
 
 namespace lve {
 
+static std::atomic< uint32_t > nextModelId{ 0 };
+
+static uint32_t vertexStride( VertexFormat format ) {
+  return format == VertexFormat::Float32 ? sizeof( Model::Vertex )
+                                         : sizeof( Model::PackedVertex );
+}
+
+static const char* const vertexFormatNames[VERTEX_FORMAT_COUNT] = {
+  "float", "snorm16", "half" };
+
+const char* vertexFormatName( VertexFormat format ) {
+  return vertexFormatNames[static_cast< uint32_t >( format )];
+}
+
+bool parseVertexFormat( const char* name, VertexFormat& format ) {
+  for ( uint32_t i = 0; i < VERTEX_FORMAT_COUNT; i++ ) {
+    if ( std::strcmp( name, vertexFormatNames[i] ) == 0 ) {
+      format = static_cast< VertexFormat >( i );
+      return true;
+    }
+  }
+  return false;
+}
+
+// vertices are welded when they are equal bit for bit
+struct VertexKey {
+  Model::Vertex vertex;
+
+  bool operator==( const VertexKey& other ) const {
+    return std::memcmp( &vertex, &other.vertex, sizeof( vertex ) ) == 0;
+  }
+};
+
+struct VertexKeyHash {
+  size_t operator()( const VertexKey& key ) const {
+    // FNV-1a over the bytes of the vertex
+    const auto* bytes = reinterpret_cast< const unsigned char* >( &key.vertex );
+    uint64_t hash = 14695981039346656037ull;
+    for ( size_t i = 0; i < sizeof( key.vertex ); i++ ) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+    return static_cast< size_t >( hash );
+  }
+};
+
+static Model::Builder weldTriangleList(
+    const std::vector< Model::Vertex >& vertices ) {
+  Model::Builder builder;
+  builder.weld( vertices );
+  return builder;
+}
+
 Model::Model( Device& _device, std::vector< Vertex >& vertices )
-    : device{ _device } {
-  createVertexBuffers( vertices );
+    : Model( _device, weldTriangleList( vertices ) ) {}
+
+Model::Model(
+    Device& _device, UploadBatch& batch, std::vector< Vertex >& vertices )
+    : Model( _device, batch, weldTriangleList( vertices ) ) {}
+
+Model::Model( Device& _device ) : device{ _device }, id{ nextModelId++ } {}
+
+Model::Model( Device& _device, const Builder& builder ) : Model( _device ) {
+  UploadBatch batch{ device };
+  upload( batch, builder );
+  batch.flush();
+  resident = true;
 }
 
-Model::~Model() {
-  vkDestroyBuffer( device.device(), vertexBuffer, nullptr );
-  vkFreeMemory( device.device(), vertexBufferMemory, nullptr );
+Model::Model( Device& _device, UploadBatch& batch, const Builder& builder )
+    : Model( _device ) {
+  upload( batch, builder );
+  resident = true;
 }
 
-void Model::createVertexBuffers( const std::vector< Vertex >& vertices ) {
-  vertexCount = static_cast< uint32_t >( vertices.size() );
+Model::Model( Device& _device, UploadBatch& batch, const MeshView& mesh )
+    : Model( _device ) {
+  upload( batch, mesh );
+  resident = true;
+}
 
+void Model::upload( UploadBatch& batch, const Builder& builder ) {
+  assert( !uploaded && "Model already has its geometry" );
+  vertexCount = static_cast< uint32_t >( builder.vertices.size() );
+  vertexFormat = builder.format;
+  indexCount = static_cast< uint32_t >( builder.indices.size() );
   assert( vertexCount >= 3 && "Vertex count must be at least 3" );
+  assert( indexCount >= 3 && "Index count must be at least 3" );
+
+  // half the index memory and bandwidth for all but the biggest meshes
+  indexType = vertexCount <= std::numeric_limits< uint16_t >::max() + 1u
+                  ? VK_INDEX_TYPE_UINT16
+                  : VK_INDEX_TYPE_UINT32;
+
+  allocateGeometry( batch );
+  writeVertices( builder, batch );
+  writeIndices( builder.indices, batch );
+  computeGeometryStats( builder );
+  uploaded = true;
+}
+
+void Model::upload( UploadBatch& batch, const MeshView& mesh ) {
+  assert( !uploaded && "Model already has its geometry" );
+  const MeshFileHeader& header = *mesh.header;
+  vertexCount = header.vertexCount;
+  vertexFormat = static_cast< VertexFormat >( header.vertexFormat );
+  positionScale = header.positionScale;
+  positionOffset = header.positionOffset;
+  boundingRadius = header.boundingRadius;
+  indexCount = header.indexCount;
+  indexType = header.indexSize == sizeof( uint16_t ) ? VK_INDEX_TYPE_UINT16
+                                                     : VK_INDEX_TYPE_UINT32;
+
+  // no intermediate copies, the staging ring reads the blobs where they are
+  allocateGeometry( batch );
+  GeometryPool& pool = device.geometryPool();
+  pool.uploadVertices( batch, geometry, mesh.vertices );
+  pool.uploadIndices( batch, geometry, mesh.indices );
+
+  geometryStats.inputVertexCount = header.inputVertexCount;
+  geometryStats.vertexCount = vertexCount;
+  geometryStats.indexCount = indexCount;
+  geometryStats.bytes = header.vertexBytes + header.indexBytes;
+  geometryStats.unindexedBytes = indexCount * sizeof( Vertex );
+  geometryStats.acmr = header.acmr;
+  geometryStats.vertexStride = vertexStride( vertexFormat );
+  geometryStats.maxPositionError = header.maxPositionError;
+  geometryStats.positionErrorBound = header.positionErrorBound;
+  geometryStats.maxColorError = header.maxColorError;
+  geometryStats.colorErrorBound = header.colorErrorBound;
+  uploaded = true;
+}
+
+Model::~Model() {
+  // a model that never got its geometry has nothing in the pool
+  if ( !uploaded ) return;
 
-  VkDeviceSize bufferSize = sizeof( vertices[0] ) * vertexCount;
+  // frames in flight may still be drawing from its ranges
+  GeometryPool& pool = device.geometryPool();
+  GeometryPool::Handle handle = geometry;
+  device.deferDestruction( [&pool, handle]() { pool.free( handle ); } );
+}
+
+void Model::allocateGeometry( UploadBatch& batch ) {
+  geometry = device.geometryPool().allocate(
+      batch, vertexStride( vertexFormat ), vertexCount,
+      indexType == VK_INDEX_TYPE_UINT16 ? sizeof( uint16_t )
+                                        : sizeof( uint32_t ),
+      indexCount );
+}
+
+void Model::Builder::weld( const std::vector< Vertex >& triangleList ) {
+  vertices.clear();
+  indices.clear();
+  indices.reserve( triangleList.size() );
+  inputVertexCount = static_cast< uint32_t >( triangleList.size() );
 
-  device.createBuffer(
-      bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      vertexBuffer, vertexBufferMemory );
+  std::unordered_map< VertexKey, uint32_t, VertexKeyHash > lookup;
+  lookup.reserve( triangleList.size() );
+  for ( const auto& vertex: triangleList ) {
+    auto inserted = lookup.emplace(
+        VertexKey{ vertex }, static_cast< uint32_t >( vertices.size() ) );
+    if ( inserted.second ) vertices.push_back( vertex );
+    indices.push_back( inserted.first->second );
+  }
+}
 
-  void* data;
+double Model::averageCacheMissRatio(
+    const std::vector< uint32_t >& indices, uint32_t cacheSize ) {
+  if ( indices.size() < 3 ) return 0.0;
 
-  vkMapMemory( device.device(), vertexBufferMemory, 0, bufferSize, 0, &data );
+  std::deque< uint32_t > cache;
+  uint64_t misses = 0;
+  for ( uint32_t index: indices ) {
+    bool hit = false;
+    for ( uint32_t cached: cache ) hit |= cached == index;
+    if ( hit ) continue;
 
-  // memcpy will copy the data from the cpu (host) onto the gpu (device)
-  // because the HOST_COHERENT_BIT bit is set, the memory of the device
-  // will automatically be flushed to keep the data on the host and the device
-  // synced. If this bit were unset, we would have to do this ourselves.
-  memcpy( data, vertices.data(), static_cast< size_t >( bufferSize ) );
-  vkUnmapMemory( device.device(), vertexBufferMemory );
+    misses++;
+    cache.push_back( index );
+    if ( cache.size() > cacheSize ) cache.pop_front();
+  }
+  return static_cast< double >( misses ) /
+         static_cast< double >( indices.size() / 3 );
 }
 
-void Model::draw( VkCommandBuffer commandBuffer ) {
-  vkCmdDraw( commandBuffer, vertexCount, 1, 0, 0 );
+void Model::computeGeometryStats( const Builder& builder ) {
+  geometryStats.inputVertexCount = builder.inputVertexCount > 0
+                                       ? builder.inputVertexCount
+                                       : indexCount;
+  geometryStats.vertexCount = vertexCount;
+  geometryStats.indexCount = indexCount;
+  geometryStats.vertexStride = vertexStride( vertexFormat );
+  geometryStats.bytes =
+      vertexCount * geometryStats.vertexStride +
+      indexCount *
+          ( indexType == VK_INDEX_TYPE_UINT16 ? sizeof( uint16_t )
+                                              : sizeof( uint32_t ) );
+  geometryStats.unindexedBytes = indexCount * sizeof( Vertex );
+  geometryStats.acmr = averageCacheMissRatio( builder.indices );
+}
+
+void Model::writeVertices( const Builder& builder, UploadBatch& batch ) {
+  const std::vector< Vertex >& vertices = builder.vertices;
+  for ( const auto& vertex: vertices ) {
+    boundingRadius = glm::max( boundingRadius, glm::length( vertex.position ) );
+  }
+
+  // the vertices live in device local memory, which is the fastest memory
+  // for the GPU to read from but usually can't be written by the CPU. The
+  // data is copied into a host visible staging buffer first, and the GPU
+  // then copies it over into the pool's vertex buffer.
+  GeometryPool& pool = device.geometryPool();
+  if ( vertexFormat == VertexFormat::Float32 ) {
+    pool.uploadVertices( batch, geometry, vertices.data() );
+    return;
+  }
+
+  Quantization quantization;
+  std::vector< PackedVertex > packed =
+      packVertices( vertices, vertexFormat, quantization );
+  positionScale = quantization.positionScale;
+  positionOffset = quantization.positionOffset;
+  geometryStats.maxPositionError = quantization.maxPositionError;
+  geometryStats.positionErrorBound = quantization.positionErrorBound;
+  geometryStats.maxColorError = quantization.maxColorError;
+  geometryStats.colorErrorBound = quantization.colorErrorBound;
+  pool.uploadVertices( batch, geometry, packed.data() );
+}
+
+std::vector< Model::PackedVertex > Model::packVertices(
+    const std::vector< Vertex >& vertices, VertexFormat format,
+    Quantization& quantization ) {
+  // positions are mapped onto [-1, 1] over the model's bounds, where both
+  // formats are most precise
+  glm::vec2 min = vertices[0].position;
+  glm::vec2 max = vertices[0].position;
+  for ( const auto& vertex: vertices ) {
+    min = glm::min( min, vertex.position );
+    max = glm::max( max, vertex.position );
+  }
+  glm::vec2& positionOffset = quantization.positionOffset;
+  glm::vec2& positionScale = quantization.positionScale;
+  positionOffset = ( min + max ) * 0.5f;
+  positionScale = ( max - min ) * 0.5f;
+  // a flat model has nothing to scale along that axis
+  if ( positionScale.x <= 0.f ) positionScale.x = 1.f;
+  if ( positionScale.y <= 0.f ) positionScale.y = 1.f;
+
+  // rounding is off by at most half a step of the format on [-1, 1]:
+  // snorm16 steps are 1 / 32767, half floats have 10 mantissa bits, so
+  // their steps are at most 2^-11 below 1
+  float step =
+      format == VertexFormat::Snorm16 ? 1.f / 32767.f : 1.f / 2048.f;
+  quantization.positionErrorBound =
+      glm::length( positionScale * ( step * 0.5f ) );
+  quantization.colorErrorBound = 0.5f / 255.f;
+
+  std::vector< PackedVertex > packed( vertices.size() );
+  for ( size_t i = 0; i < vertices.size(); i++ ) {
+    glm::vec2 normalized =
+        ( vertices[i].position - positionOffset ) / positionScale;
+    glm::vec4 color{ glm::clamp( vertices[i].color, 0.f, 1.f ), 1.f };
+
+    glm::vec2 decoded;
+    if ( format == VertexFormat::Snorm16 ) {
+      packed[i].position = glm::packSnorm2x16( normalized );
+      decoded = glm::unpackSnorm2x16( packed[i].position );
+    } else {
+      packed[i].position = glm::packHalf2x16( normalized );
+      decoded = glm::unpackHalf2x16( packed[i].position );
+    }
+    packed[i].color = glm::packUnorm4x8( color );
+
+    glm::vec3 decodedColor{ glm::unpackUnorm4x8( packed[i].color ) };
+    glm::vec3 colorError = glm::abs( decodedColor - glm::vec3{ color } );
+    quantization.maxPositionError = glm::max(
+        quantization.maxPositionError,
+        glm::length(
+            decoded * positionScale + positionOffset -
+            vertices[i].position ) );
+    quantization.maxColorError = glm::max(
+        quantization.maxColorError,
+        glm::max( colorError.x, glm::max( colorError.y, colorError.z ) ) );
+  }
+
+  // a little slack for the float math of the check itself
+  assert(
+      quantization.maxPositionError <=
+          quantization.positionErrorBound * 1.01f + 1e-6f &&
+      "quantized positions are off by more than the format allows" );
+  return packed;
+}
+
+void Model::writeIndices(
+    const std::vector< uint32_t >& indices, UploadBatch& batch ) {
+  // the batch copies the data into staging memory right away
+  GeometryPool& pool = device.geometryPool();
+  if ( indexType == VK_INDEX_TYPE_UINT32 ) {
+    pool.uploadIndices( batch, geometry, indices.data() );
+    return;
+  }
+
+  std::vector< uint16_t > shortIndices( indices.begin(), indices.end() );
+  pool.uploadIndices( batch, geometry, shortIndices.data() );
+}
+
+void Model::draw(
+    VkCommandBuffer commandBuffer, uint32_t instanceCount,
+    uint32_t firstInstance ) {
+  const GeometryPool& pool = device.geometryPool();
+  vkCmdDrawIndexed(
+      commandBuffer, indexCount, instanceCount, pool.getFirstIndex( geometry ),
+      pool.getVertexOffset( geometry ), firstInstance );
 }
 
 void Model::bind( VkCommandBuffer commandBuffer ) {
-  VkBuffer buffers[] = { vertexBuffer };
-  VkDeviceSize offsets[] = { 0 };
+  device.geometryPool().bind( commandBuffer, indexType );
+}
 
-  vkCmdBindVertexBuffers( commandBuffer, 0, 1, buffers, offsets );
+VkDrawIndexedIndirectCommand Model::getDrawCommand() const {
+  const GeometryPool& pool = device.geometryPool();
+  VkDrawIndexedIndirectCommand command{};
+  command.indexCount = indexCount;
+  command.firstIndex = pool.getFirstIndex( geometry );
+  command.vertexOffset = pool.getVertexOffset( geometry );
+  return command;
 }
 
 std::vector< VkVertexInputBindingDescription >
-Model::Vertex::getBindingDescriptions() {
-  std::vector< VkVertexInputBindingDescription > bindingDescriptions( 1 );
+Model::Vertex::getBindingDescriptions(
+    bool instanced, VertexFormat format ) {
+  std::vector< VkVertexInputBindingDescription > bindingDescriptions(
+      instanced ? 2 : 1 );
   bindingDescriptions[0].binding = 0;
-  bindingDescriptions[0].stride = sizeof( Vertex );
+  bindingDescriptions[0].stride = format == VertexFormat::Float32
+                                      ? sizeof( Vertex )
+                                      : sizeof( PackedVertex );
   bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
+  if ( instanced ) {
+    bindingDescriptions[1].binding = 1;
+    bindingDescriptions[1].stride = sizeof( Instance );
+    bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+  }
+
   return bindingDescriptions;
 }
 
 std::vector< VkVertexInputAttributeDescription >
-Model::Vertex::getAttributeDescriptions() {
-  std::vector< VkVertexInputAttributeDescription > attributeDescriptions( 2 );
+Model::Vertex::getAttributeDescriptions(
+    bool instanced, VertexFormat format ) {
+  std::vector< VkVertexInputAttributeDescription > attributeDescriptions(
+      instanced ? 6 : 2 );
   attributeDescriptions[0].binding = 0;
   attributeDescriptions[0].location = 0;
   attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
@@ -74,6 +378,41 @@ Model::Vertex::getAttributeDescriptions() {
   attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
   attributeDescriptions[1].offset = offsetof( Vertex, color );
 
+  // the vertex fetch unit converts the compact formats, shaders still get
+  // a vec2 position and a vec3 color; the alpha of the color is dropped
+  if ( format != VertexFormat::Float32 ) {
+    attributeDescriptions[0].format = format == VertexFormat::Snorm16
+                                          ? VK_FORMAT_R16G16_SNORM
+                                          : VK_FORMAT_R16G16_SFLOAT;
+    attributeDescriptions[0].offset = offsetof( PackedVertex, position );
+    attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    attributeDescriptions[1].offset = offsetof( PackedVertex, color );
+  }
+
+  if ( !instanced ) return attributeDescriptions;
+
+  // a mat2 takes up one location per column
+  attributeDescriptions[2].binding = 1;
+  attributeDescriptions[2].location = 2;
+  attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
+  attributeDescriptions[2].offset = offsetof( Instance, transform );
+
+  attributeDescriptions[3].binding = 1;
+  attributeDescriptions[3].location = 3;
+  attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
+  attributeDescriptions[3].offset =
+      offsetof( Instance, transform ) + sizeof( glm::vec2 );
+
+  attributeDescriptions[4].binding = 1;
+  attributeDescriptions[4].location = 4;
+  attributeDescriptions[4].format = VK_FORMAT_R32G32_SFLOAT;
+  attributeDescriptions[4].offset = offsetof( Instance, offset );
+
+  attributeDescriptions[5].binding = 1;
+  attributeDescriptions[5].location = 5;
+  attributeDescriptions[5].format = VK_FORMAT_R32G32B32_SFLOAT;
+  attributeDescriptions[5].offset = offsetof( Instance, color );
+
   return attributeDescriptions;
 }
 
@@ -1,24 +1,66 @@
 #pragma once
 
 #include "device.hpp"
+#include "geometry_pool.hpp"
+#include "upload_batch.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <cassert>
 #include <glm/glm.hpp>
 #include <vector>
 
 namespace lve {
 
+// how a model stores its vertices. Positions of the compact formats are
+// normalized to the model's bounds; the scale and offset that undo this are
+// folded into the object transform (Model::dequantize), and the vertex input
+// formats hand the shaders plain floats. The same shaders therefore work
+// with every format, only the pipelines' vertex input state differs
+enum class VertexFormat {
+  // vec2 position, vec3 color: 20 bytes
+  Float32,
+  // snorm16x2 position, unorm8x4 color: 8 bytes
+  Snorm16,
+  // float16x2 position, unorm8x4 color: 8 bytes
+  Half
+};
+constexpr uint32_t VERTEX_FORMAT_COUNT = 3;
+
+// "float", "snorm16" and "half", as taken on the command line
+const char* vertexFormatName( VertexFormat );
+bool parseVertexFormat( const char* name, VertexFormat& format );
+
+struct MeshView;
+
 class Model {
  public:
   struct Vertex {
     glm::vec2 position;
     glm::vec3 color;
 
+    // with instanced set, binding 1 carries one Instance per instance
     static std::vector< VkVertexInputBindingDescription >
-    getBindingDescriptions();
+    getBindingDescriptions(
+        bool instanced = false, VertexFormat format = VertexFormat::Float32 );
     static std::vector< VkVertexInputAttributeDescription >
-    getAttributeDescriptions();
+    getAttributeDescriptions(
+        bool instanced = false, VertexFormat format = VertexFormat::Float32 );
+  };
+
+  // a vertex of the 8 byte formats: two 16 bit position components and
+  // rgba8 color
+  struct PackedVertex {
+    uint32_t position;
+    uint32_t color;
+  };
+
+  // per object data for instanced draws, read by
+  // simple_shader_instanced.vert from vertex binding 1
+  struct Instance {
+    glm::mat2 transform;
+    glm::vec2 offset;
+    glm::vec3 color;
   };
 
   struct Triangle {
@@ -29,21 +71,141 @@ class Model {
     std::vector< Vertex > getVertices();
   };
 
+  // indexed geometry for a model. Triangle lists, where every triangle
+  // carries its own three vertices, go through weld(), which keeps one copy
+  // of every distinct vertex and points the indices at it
+  struct Builder {
+    std::vector< Vertex > vertices;
+    std::vector< uint32_t > indices;
+    // vertices before welding, for the stats
+    uint32_t inputVertexCount = 0;
+    VertexFormat format = VertexFormat::Float32;
+
+    void weld( const std::vector< Vertex >& triangleList );
+  };
+
+  struct GeometryStats {
+    uint32_t inputVertexCount = 0;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    // vertex and index buffers, and what a plain triangle list would take
+    VkDeviceSize bytes = 0;
+    VkDeviceSize unindexedBytes = 0;
+    // vertex shader invocations per triangle with a 32 entry FIFO post
+    // transform cache; 3 without any reuse, 0.5 at best for large meshes
+    double acmr = 0.0;
+    uint32_t vertexStride = 0;
+    // largest distance between a stored and the original position, in
+    // model space, and what the format guarantees it to be below; both 0
+    // for Float32. Same for color components
+    float maxPositionError = 0.f;
+    float positionErrorBound = 0.f;
+    float maxColorError = 0.f;
+    float colorErrorBound = 0.f;
+  };
+
+  // how packVertices mapped the positions onto the format, and how far
+  // the stored vertices are off
+  struct Quantization {
+    // stored position * scale + offset = model space position
+    glm::vec2 positionScale{ 1.f, 1.f };
+    glm::vec2 positionOffset{ 0.f, 0.f };
+    float maxPositionError = 0.f;
+    float positionErrorBound = 0.f;
+    float maxColorError = 0.f;
+    float colorErrorBound = 0.f;
+  };
+
+  // encodes vertices in one of the 8 byte formats and measures the error
+  static std::vector< PackedVertex > packVertices(
+      const std::vector< Vertex >& vertices, VertexFormat format,
+      Quantization& quantization );
+
+  // average cache miss ratio of drawing indices with a FIFO vertex cache
+  static double averageCacheMissRatio(
+      const std::vector< uint32_t >& indices, uint32_t cacheSize = 32 );
+
+  // a pending model: it has an id, but no geometry until upload() is
+  // called, e.g. once a background loader is done with it
+  explicit Model( Device& );
+  // triangle lists are welded on the way in
   Model( Device&, std::vector< Vertex >& );
+  // queues the vertex upload on a batch instead of submitting it right away,
+  // so that many models can be loaded with a single submission
+  Model( Device&, UploadBatch&, std::vector< Vertex >& );
+  Model( Device&, const Builder& );
+  Model( Device&, UploadBatch&, const Builder& );
+  // geometry that is already in its final format, e.g. a mapped mesh file.
+  // The data is copied into staging memory before this returns, so the
+  // view may go away right after
+  Model( Device&, UploadBatch&, const MeshView& );
   ~Model();
   Model( const Model& ) = delete;
   Model& operator=( const Model& ) = delete;
 
+  // main thread only, like every upload. May be called once, on a model
+  // created without geometry. The model stays pending until setResident()
+  void upload( UploadBatch&, const Builder& );
+  void upload( UploadBatch&, const MeshView& );
+  // whether the model may be bound and drawn. The constructors that take
+  // geometry make it resident right away: frames are submitted after its
+  // upload and wait for it. Whoever uploads a pending model decides when it
+  // is, e.g. only once the copy has completed so that no frame waits for it
+  bool isResident() const { return resident; }
+  void setResident() {
+    assert( uploaded && "Model has no geometry to draw" );
+    resident = true;
+  }
+
+  // binds the geometry pool. Models only differ in their index type, so
+  // the next model only needs binding again if that changes
   void bind( VkCommandBuffer );
-  void draw( VkCommandBuffer );
+  // unique among all models created by the process, e.g. for sort keys
+  uint32_t getId() const { return id; }
+  uint32_t getVertexCount() { return vertexCount; }
+  uint32_t getIndexCount() { return indexCount; }
+  VertexFormat getVertexFormat() const { return vertexFormat; }
+  VkIndexType getIndexType() const { return indexType; }
+  // turns the transform of an object from model space into one that
+  // applies to the positions as stored
+  void dequantize( glm::mat2& transform, glm::vec2& offset ) const {
+    offset += transform * positionOffset;
+    transform = transform * glm::mat2{ { positionScale.x, 0.f },
+                                       { 0.f, positionScale.y } };
+  }
+  const GeometryStats& getGeometryStats() const { return geometryStats; }
+  // radius around the origin that contains every vertex, for culling
+  float getBoundingRadius() const { return boundingRadius; }
+  // firstInstance selects where in the bound instance buffer the instances
+  // of this draw start
+  void draw(
+      VkCommandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0 );
+  // what draw() records, for indirect draws; instances are left at 0
+  VkDrawIndexedIndirectCommand getDrawCommand() const;
 
  private:
   Device& device;
-  VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-  uint32_t vertexCount;
+  const uint32_t id;
+  bool uploaded = false;
+  bool resident = false;
+  // where the vertices and indices are in the device's geometry pool
+  GeometryPool::Handle geometry = GeometryPool::NO_GEOMETRY;
+  uint32_t vertexCount = 0;
+  VertexFormat vertexFormat = VertexFormat::Float32;
+  // stored position * scale + offset = model space position
+  glm::vec2 positionScale{ 1.f, 1.f };
+  glm::vec2 positionOffset{ 0.f, 0.f };
+  uint32_t indexCount = 0;
+  // 16 bit indices when every vertex can be reached with them
+  VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+  float boundingRadius = 0.f;
+  GeometryStats geometryStats;
 
-  void createVertexBuffers( const std::vector< Vertex >& );
+  // takes the counts, format and index type as already set
+  void allocateGeometry( UploadBatch& );
+  void writeVertices( const Builder&, UploadBatch& );
+  void writeIndices( const std::vector< uint32_t >&, UploadBatch& );
+  void computeGeometryStats( const Builder& );
 };
 
 }  // namespace lve
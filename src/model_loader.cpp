@@ -0,0 +1,161 @@
+#include "model_loader.hpp"
+
+#include "upload_batch.hpp"
+
+// std headers
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+namespace lve {
+
+// reads a byte of every page. Pages are at least 4 KiB, larger ones are just
+// read more than once
+static void touchPages( const void* data, uint64_t size ) {
+  const auto* bytes = static_cast< const volatile unsigned char* >( data );
+  for ( uint64_t offset = 0; offset < size; offset += 4096 ) bytes[offset];
+}
+
+ModelLoader::ModelLoader(
+    Device& _device, ModelRegistry* _registry, uint32_t threadCount,
+    VkDeviceSize _uploadBudget )
+    : device{ _device }, registry{ _registry }, uploadBudget{ _uploadBudget } {
+  if ( threadCount == 0 ) {
+    uint32_t cores = std::thread::hardware_concurrency();
+    threadCount = std::max( cores, 2u ) - 1;
+  }
+
+  for ( uint32_t i = 0; i < threadCount; i++ )
+    workers.emplace_back( &ModelLoader::work, this );
+}
+
+ModelLoader::~ModelLoader() {
+  {
+    std::lock_guard< std::mutex > lock{ jobMutex };
+    stopping = true;
+  }
+  jobAvailable.notify_all();
+  for ( auto& worker: workers ) worker.join();
+  // the results left in the queue are freed with it. Their models never got
+  // any buffers, so they may be destroyed anywhere
+}
+
+std::shared_ptr< Model > ModelLoader::load( Generator generate ) {
+  auto model = std::make_shared< Model >( device );
+  submit( { model, std::move( generate ), {} } );
+  return model;
+}
+
+std::shared_ptr< Model > ModelLoader::loadFile( const std::string& path ) {
+  auto model = std::make_shared< Model >( device );
+  submit( { model, nullptr, path } );
+  return model;
+}
+
+void ModelLoader::submit( Job job ) {
+  {
+    std::lock_guard< std::mutex > lock{ jobMutex };
+    jobs.push_back( std::move( job ) );
+  }
+  jobAvailable.notify_one();
+  stats.requested++;
+}
+
+void ModelLoader::work() {
+  for ( ;; ) {
+    Job job;
+    {
+      std::unique_lock< std::mutex > lock{ jobMutex };
+      jobAvailable.wait( lock, [this]() { return stopping || !jobs.empty(); } );
+      if ( stopping ) return;
+      job = std::move( jobs.front() );
+      jobs.pop_front();
+    }
+
+    auto result = std::make_unique< Result >();
+    result->model = std::move( job.model );
+    try {
+      run( job, *result );
+    } catch ( const std::exception& e ) {
+      result->error = e.what();
+    }
+    results.push( std::move( result ) );
+  }
+}
+
+void ModelLoader::run( Job& job, Result& result ) {
+  if ( job.generate ) {
+    job.generate( result.builder );
+    if ( result.builder.vertices.size() < 3 ||
+         result.builder.indices.size() < 3 )
+      throw std::runtime_error( "generated mesh has no triangles" );
+    return;
+  }
+
+  result.file = std::make_unique< MeshFile >( job.path );
+
+  // fault the pages in here, so that the upload on the main thread copies
+  // from memory instead of waiting for the disk. The indices already were,
+  // when the file was checked
+  MeshView view = result.file->getView();
+  touchPages( view.vertices, view.header->vertexBytes );
+}
+
+void ModelLoader::update() {
+  auto completed = std::remove_if(
+      uploads.begin(), uploads.end(), [this]( const Upload& upload ) {
+        if ( !device.isUploadComplete( upload.ticket ) ) return false;
+        upload.model->setResident();
+        return true;
+      } );
+  stats.resident += static_cast< uint32_t >( uploads.end() - completed );
+  uploads.erase( completed, uploads.end() );
+
+  std::unique_ptr< Result > result;
+  while ( results.pop( result ) ) ready.push_back( std::move( result ) );
+  if ( ready.empty() ) return;
+
+  UploadBatch batch{ device };
+  std::vector< std::shared_ptr< Model > > uploaded;
+  VkDeviceSize bytes = 0;
+  while ( !ready.empty() && ( uploaded.empty() || bytes < uploadBudget ) ) {
+    result = std::move( ready.front() );
+    ready.pop_front();
+
+    if ( !result->error.empty() ) {
+      // the model stays pending for good
+      std::cerr << "failed to load model: " << result->error << std::endl;
+      stats.failed++;
+      continue;
+    }
+
+    if ( registry != nullptr ) {
+      std::shared_ptr< Model > model =
+          result->file != nullptr
+              ? registry->adopt( batch, result->file->getView(), result->model )
+              : registry->adopt( batch, result->builder, result->model );
+      if ( model != result->model ) {
+        replaced.push_back( { std::move( result->model ), model } );
+        stats.shared++;
+        continue;
+      }
+    } else if ( result->file != nullptr ) {
+      result->model->upload( batch, result->file->getView() );
+    } else {
+      result->model->upload( batch, result->builder );
+    }
+    bytes += result->model->getGeometryStats().bytes;
+    uploaded.push_back( std::move( result->model ) );
+  }
+  if ( uploaded.empty() ) return;
+
+  // the models become resident in a later update, once the copy is done
+  UploadTicket ticket = batch.flush();
+  for ( auto& model: uploaded ) uploads.push_back( { model, ticket } );
+
+  stats.uploaded += static_cast< uint32_t >( uploaded.size() );
+  stats.uploadedBytes += bytes;
+  stats.uploadBatches++;
+}
+
+}  // namespace lve
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "device.hpp"
+#include "mesh_file.hpp"
+#include "model.hpp"
+#include "model_registry.hpp"
+#include "mpsc_queue.hpp"
+
+// std lib headers
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lve {
+
+struct ModelLoaderStats {
+  uint32_t requested = 0;
+  uint32_t uploaded = 0;
+  uint32_t resident = 0;
+  uint32_t failed = 0;
+  // loaded, but the registry already had a model with the same geometry
+  uint32_t shared = 0;
+  VkDeviceSize uploadedBytes = 0;
+  // updates that queued at least one upload
+  uint32_t uploadBatches = 0;
+};
+
+// loads models in the background: worker threads generate meshes or map and
+// read in mesh files, and hand them back to the main thread through a lock
+// free queue. The main thread only queues the uploads, a few per frame, and
+// update() makes the models resident once those have completed. Until then
+// they are pending, and whoever draws them has to check Model::isResident.
+//
+// With a registry, a loaded model whose geometry the registry already has
+// isn't uploaded; it is replaced by the registry's model, and whoever holds
+// it swaps it for that one through takeReplaced()
+class ModelLoader {
+ public:
+  struct Replacement {
+    std::shared_ptr< Model > pending;
+    std::shared_ptr< Model > model;
+  };
+
+  // fills in a builder on a worker thread, so it must not touch anything the
+  // main thread uses. The builder has to be indexed, e.g. through weld()
+  using Generator = std::function< void( Model::Builder& ) >;
+
+  // threadCount 0 leaves one core to the main thread. Each update uploads
+  // up to about uploadBudget bytes, but always at least one model
+  ModelLoader(
+      Device&, ModelRegistry* registry = nullptr, uint32_t threadCount = 0,
+      VkDeviceSize uploadBudget = Device::STAGING_RING_SIZE / 4 );
+  // models that are still being loaded stay pending
+  ~ModelLoader();
+  ModelLoader( const ModelLoader& ) = delete;
+  ModelLoader& operator=( const ModelLoader& ) = delete;
+
+  // both return a pending model right away
+  std::shared_ptr< Model > load( Generator generate );
+  std::shared_ptr< Model > loadFile( const std::string& path );
+
+  // main thread, once per frame: makes the models whose upload has
+  // completed resident, and queues the uploads of what the workers have
+  // finished in one batch. Residency only changes here, so it stays the
+  // same while a frame is recorded
+  void update();
+
+  // requested models that are neither resident, failed nor replaced
+  uint32_t getPendingCount() const {
+    return stats.requested - stats.resident - stats.failed - stats.shared;
+  }
+  // the models replaced since the last call. The pending ones never get
+  // geometry
+  std::vector< Replacement > takeReplaced() {
+    std::vector< Replacement > taken;
+    taken.swap( replaced );
+    return taken;
+  }
+  const ModelLoaderStats& getStats() const { return stats; }
+
+ private:
+  struct Job {
+    std::shared_ptr< Model > model;
+    // either of them
+    Generator generate;
+    std::string path;
+  };
+
+  struct Result {
+    std::shared_ptr< Model > model;
+    Model::Builder builder;
+    // kept mapped until the upload has copied it
+    std::unique_ptr< MeshFile > file;
+    std::string error;
+  };
+
+  Device& device;
+  ModelRegistry* registry;
+  VkDeviceSize uploadBudget;
+  std::vector< std::thread > workers;
+
+  // written by the main thread, taken by the workers
+  std::mutex jobMutex;
+  std::condition_variable jobAvailable;
+  std::deque< Job > jobs;
+  bool stopping = false;
+
+  MpscQueue< std::unique_ptr< Result > > results;
+  // taken from the queue, but over the budget of their update
+  std::deque< std::unique_ptr< Result > > ready;
+  struct Upload {
+    std::shared_ptr< Model > model;
+    UploadTicket ticket;
+  };
+  // queued, but not complete as of the last update
+  std::vector< Upload > uploads;
+  std::vector< Replacement > replaced;
+  ModelLoaderStats stats;
+
+  void submit( Job job );
+  void work();
+  static void run( Job& job, Result& result );
+};
+
+}  // namespace lve
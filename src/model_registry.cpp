@@ -0,0 +1,171 @@
+#include "model_registry.hpp"
+
+#include "mesh_file.hpp"
+
+// std headers
+#include <cstring>
+#include <limits>
+
+namespace lve {
+
+namespace {
+
+uint64_t rotateLeft( uint64_t value, int bits ) {
+  return ( value << bits ) | ( value >> ( 64 - bits ) );
+}
+
+// murmur3's finalizer, so that every input bit affects every output bit
+uint64_t finalize( uint64_t hash ) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// eight bytes per step, which is what makes it fast on large meshes; not
+// meant to stand up to deliberately crafted collisions
+uint64_t hashBytes( const void* data, size_t size, uint64_t hash ) {
+  const auto* bytes = static_cast< const unsigned char* >( data );
+  const uint64_t k1 = 0x87c37b91114253d5ull;
+  const uint64_t k2 = 0x4cf5ad432745937full;
+
+  size_t i = 0;
+  for ( ; i + 8 <= size; i += 8 ) {
+    uint64_t word;
+    std::memcpy( &word, bytes + i, sizeof( word ) );
+    hash ^= rotateLeft( word * k1, 31 ) * k2;
+    hash = rotateLeft( hash, 27 ) * 5 + 0x52dce729;
+  }
+
+  uint64_t tail = 0;
+  for ( size_t shift = 0; i < size; i++, shift += 8 )
+    tail |= static_cast< uint64_t >( bytes[i] ) << shift;
+  hash ^= rotateLeft( tail * k1, 31 ) * k2;
+
+  return finalize( hash ^ size );
+}
+
+}  // namespace
+
+ModelRegistry::ModelRegistry( Device& _device, VkDeviceSize _budget )
+    : device{ _device }, budget{ _budget } {}
+
+ModelRegistry::Key ModelRegistry::keyOf( const Model::Builder& builder ) {
+  Key key{};
+  key.hash = hashBytes(
+      builder.vertices.data(),
+      builder.vertices.size() * sizeof( Model::Vertex ), 0 );
+  key.hash = hashBytes(
+      builder.indices.data(), builder.indices.size() * sizeof( uint32_t ),
+      key.hash );
+  key.vertexCount = static_cast< uint32_t >( builder.vertices.size() );
+  key.indexCount = static_cast< uint32_t >( builder.indices.size() );
+  key.format = builder.format;
+  return key;
+}
+
+ModelRegistry::Key ModelRegistry::keyOf( const MeshView& mesh ) {
+  const MeshFileHeader& header = *mesh.header;
+  // the blobs are already in their final format, so the same geometry
+  // hashes differently here than from a builder. The seed keeps the two
+  // apart for good
+  Key key{};
+  key.hash = hashBytes(
+      mesh.vertices, header.vertexBytes,
+      std::numeric_limits< uint64_t >::max() );
+  key.hash = hashBytes( mesh.indices, header.indexBytes, key.hash );
+  key.vertexCount = header.vertexCount;
+  key.indexCount = header.indexCount;
+  key.format = static_cast< VertexFormat >( header.vertexFormat );
+  return key;
+}
+
+std::shared_ptr< Model > ModelRegistry::get(
+    UploadBatch& batch, const Model::Builder& builder ) {
+  Key key = keyOf( builder );
+  std::shared_ptr< Model > model = find( key );
+  if ( model != nullptr ) return model;
+
+  model = std::make_shared< Model >( device, batch, builder );
+  add( key, model );
+  return model;
+}
+
+std::shared_ptr< Model > ModelRegistry::get(
+    UploadBatch& batch, const MeshView& mesh ) {
+  Key key = keyOf( mesh );
+  std::shared_ptr< Model > model = find( key );
+  if ( model != nullptr ) return model;
+
+  model = std::make_shared< Model >( device, batch, mesh );
+  add( key, model );
+  return model;
+}
+
+std::shared_ptr< Model > ModelRegistry::adopt(
+    UploadBatch& batch, const Model::Builder& builder,
+    const std::shared_ptr< Model >& pending ) {
+  Key key = keyOf( builder );
+  std::shared_ptr< Model > model = find( key );
+  if ( model != nullptr ) return model;
+
+  pending->upload( batch, builder );
+  add( key, pending );
+  return pending;
+}
+
+std::shared_ptr< Model > ModelRegistry::adopt(
+    UploadBatch& batch, const MeshView& mesh,
+    const std::shared_ptr< Model >& pending ) {
+  Key key = keyOf( mesh );
+  std::shared_ptr< Model > model = find( key );
+  if ( model != nullptr ) return model;
+
+  pending->upload( batch, mesh );
+  add( key, pending );
+  return pending;
+}
+
+std::shared_ptr< Model > ModelRegistry::find( const Key& key ) {
+  stats.lookups++;
+  auto entry = entries.find( key );
+  if ( entry == entries.end() ) return nullptr;
+
+  stats.hits++;
+  stats.bytesSaved += entry->second.bytes;
+  entry->second.lastUsed = stats.lookups;
+  return entry->second.model;
+}
+
+void ModelRegistry::add(
+    const Key& key, const std::shared_ptr< Model >& model ) {
+  VkDeviceSize bytes = model->getGeometryStats().bytes;
+  entries.emplace( key, Entry{ model, bytes, stats.lookups } );
+  stats.bytes += bytes;
+  stats.models++;
+  trim();
+}
+
+void ModelRegistry::trim() {
+  while ( stats.bytes > budget ) {
+    // a linear search is fine for the few thousand models a scene has, and
+    // eviction only happens when over budget
+    auto victim = entries.end();
+    for ( auto it = entries.begin(); it != entries.end(); ++it ) {
+      if ( it->second.model.use_count() > 1 ) continue;
+      if ( victim == entries.end() ||
+           it->second.lastUsed < victim->second.lastUsed )
+        victim = it;
+    }
+    if ( victim == entries.end() ) return;
+
+    stats.bytes -= victim->second.bytes;
+    stats.models--;
+    stats.evictions++;
+    entries.erase( victim );
+  }
+}
+
+}  // namespace lve
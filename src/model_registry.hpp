@@ -0,0 +1,103 @@
+#pragma once
+
+#include "device.hpp"
+#include "model.hpp"
+#include "upload_batch.hpp"
+
+// std lib headers
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+namespace lve {
+
+struct ModelRegistryStats {
+  uint64_t lookups = 0;
+  uint64_t hits = 0;
+  // geometry that didn't have to be uploaded again thanks to the hits
+  VkDeviceSize bytesSaved = 0;
+  uint64_t evictions = 0;
+  // of the models the registry holds on to right now
+  VkDeviceSize bytes = 0;
+  uint32_t models = 0;
+
+  double hitRate() const {
+    return lookups > 0 ? static_cast< double >( hits ) / lookups : 0.0;
+  }
+};
+
+// hands out one model per distinct geometry. Models are found by a 64 bit
+// hash of their vertex and index data together with their counts and vertex
+// format; the data itself isn't kept around to compare, so two different
+// meshes would only be mixed up on a full hash collision.
+//
+// The registry keeps every model alive, and evicts the least recently
+// requested ones that nothing else holds on to once its models take up more
+// than the budget. Models that are still referenced are never evicted, so
+// the budget may be exceeded by them
+class ModelRegistry {
+ public:
+  static constexpr VkDeviceSize DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+  ModelRegistry( Device&, VkDeviceSize budget = DEFAULT_BUDGET );
+  ModelRegistry( const ModelRegistry& ) = delete;
+  ModelRegistry& operator=( const ModelRegistry& ) = delete;
+
+  // the model with this geometry, uploaded on the batch if there is none
+  // yet
+  std::shared_ptr< Model > get( UploadBatch&, const Model::Builder& );
+  std::shared_ptr< Model > get( UploadBatch&, const MeshView& );
+  // the same for a pending model that has just been loaded: if no model
+  // has this geometry yet, it is uploaded into pending, which is returned
+  // and registered. Otherwise pending is left alone
+  std::shared_ptr< Model > adopt(
+      UploadBatch&, const Model::Builder&,
+      const std::shared_ptr< Model >& pending );
+  std::shared_ptr< Model > adopt(
+      UploadBatch&, const MeshView&, const std::shared_ptr< Model >& pending );
+
+  // evicts unreferenced models until the budget is met. Also done whenever
+  // a model is added
+  void trim();
+
+  const ModelRegistryStats& getStats() const { return stats; }
+
+ private:
+  struct Key {
+    uint64_t hash;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    VertexFormat format;
+
+    bool operator==( const Key& other ) const {
+      return hash == other.hash && vertexCount == other.vertexCount &&
+             indexCount == other.indexCount && format == other.format;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()( const Key& key ) const {
+      return static_cast< size_t >( key.hash );
+    }
+  };
+
+  struct Entry {
+    std::shared_ptr< Model > model;
+    VkDeviceSize bytes;
+    // lookup count at the last hit, for least recently used eviction
+    uint64_t lastUsed;
+  };
+
+  Device& device;
+  VkDeviceSize budget;
+  std::unordered_map< Key, Entry, KeyHash > entries;
+  ModelRegistryStats stats;
+
+  static Key keyOf( const Model::Builder& builder );
+  static Key keyOf( const MeshView& mesh );
+  // the entry's model on a hit, null on a miss
+  std::shared_ptr< Model > find( const Key& key );
+  void add( const Key& key, const std::shared_ptr< Model >& model );
+};
+
+}  // namespace lve
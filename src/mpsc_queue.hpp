@@ -0,0 +1,67 @@
+#pragma once
+
+// std lib headers
+#include <atomic>
+#include <utility>
+
+namespace lve {
+
+// a queue that any number of threads push to and a single thread pops from,
+// without locks. Pushes go onto a stack with a compare and swap; the
+// consumer takes the whole stack at once with an exchange and reverses it,
+// so items come out in the order they were pushed. Since nodes only ever
+// leave the stack all together, a producer can't be looking at a node that
+// is popped under it (no ABA)
+template < typename T >
+class MpscQueue {
+ public:
+  MpscQueue() = default;
+  ~MpscQueue() {
+    T value;
+    while ( pop( value ) ) {
+    }
+  }
+  MpscQueue( const MpscQueue& ) = delete;
+  MpscQueue& operator=( const MpscQueue& ) = delete;
+
+  void push( T value ) {
+    Node* node = new Node{
+        std::move( value ), head.load( std::memory_order_relaxed ) };
+    while ( !head.compare_exchange_weak(
+        node->next, node, std::memory_order_release,
+        std::memory_order_relaxed ) ) {
+    }
+  }
+
+  // consumer only
+  bool pop( T& value ) {
+    if ( taken == nullptr ) {
+      Node* node = head.exchange( nullptr, std::memory_order_acquire );
+      while ( node != nullptr ) {
+        Node* next = node->next;
+        node->next = taken;
+        taken = node;
+        node = next;
+      }
+      if ( taken == nullptr ) return false;
+    }
+
+    Node* node = taken;
+    taken = node->next;
+    value = std::move( node->value );
+    delete node;
+    return true;
+  }
+
+ private:
+  struct Node {
+    T value;
+    Node* next;
+  };
+
+  std::atomic< Node* > head{ nullptr };
+  // taken off the stack, oldest first; only touched by the consumer
+  Node* taken = nullptr;
+};
+
+}  // namespace lve
@@ -0,0 +1,50 @@
+#include "per_frame_buffer.hpp"
+
+// std headers
+#include <algorithm>
+
+namespace lve {
+
+PerFrameBuffer::PerFrameBuffer(
+    Device& _device, uint32_t framesInFlight, VkBufferUsageFlags _usage,
+    VkMemoryPropertyFlags _properties )
+    : device{ _device },
+      usage{ _usage },
+      properties{ _properties },
+      frames( framesInFlight ) {}
+
+PerFrameBuffer::~PerFrameBuffer() {
+  for ( auto& frame: frames ) retire( frame );
+}
+
+bool PerFrameBuffer::reserve( uint32_t frameIndex, VkDeviceSize size ) {
+  Frame& frame = frames[frameIndex];
+  if ( frame.capacity >= size ) return false;
+
+  // grow geometrically so that adding objects one by one doesn't reallocate
+  // every frame
+  VkDeviceSize capacity = std::max(
+      size, std::max( frame.capacity * 2, VkDeviceSize{ 4096 } ) );
+  retire( frame );
+
+  device.createBuffer(
+      capacity, usage, properties, frame.buffer, frame.allocation );
+  frame.capacity = capacity;
+  return true;
+}
+
+void PerFrameBuffer::retire( Frame& frame ) {
+  if ( frame.buffer == VK_NULL_HANDLE ) return;
+
+  Device& owner = device;
+  VkBuffer buffer = frame.buffer;
+  Allocation allocation = frame.allocation;
+  device.deferDestruction( [&owner, buffer, allocation]() mutable {
+    vkDestroyBuffer( owner.device(), buffer, nullptr );
+    owner.freeMemory( allocation );
+  } );
+
+  frame = Frame{};
+}
+
+}  // namespace lve
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "device.hpp"
+
+// std lib headers
+#include <vector>
+
+namespace lve {
+
+// one buffer per frame in flight, for data the CPU or GPU rewrites every
+// frame. A frame slot's buffer may only be touched once the fence of the
+// frame that last used the slot was waited for. Buffers grow on demand; the
+// buffer being replaced goes through the device's deferred destruction,
+// since descriptors or draws of frames in flight may still reference it
+class PerFrameBuffer {
+ public:
+  PerFrameBuffer(
+      Device& device, uint32_t framesInFlight, VkBufferUsageFlags usage,
+      VkMemoryPropertyFlags properties );
+  ~PerFrameBuffer();
+  PerFrameBuffer( const PerFrameBuffer& ) = delete;
+  PerFrameBuffer& operator=( const PerFrameBuffer& ) = delete;
+
+  // makes the slot's buffer hold at least size bytes. Returns true if a new
+  // buffer was created, e.g. so descriptors pointing at it can be updated;
+  // the contents are not carried over
+  bool reserve( uint32_t frameIndex, VkDeviceSize size );
+
+  VkBuffer getBuffer( uint32_t frameIndex ) {
+    return frames[frameIndex].buffer;
+  }
+  // null unless the memory is host visible
+  void* getMappedMemory( uint32_t frameIndex ) {
+    return frames[frameIndex].allocation.mapped;
+  }
+  VkDeviceSize getCapacity( uint32_t frameIndex ) {
+    return frames[frameIndex].capacity;
+  }
+
+ private:
+  struct Frame {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation allocation{};
+    VkDeviceSize capacity = 0;
+  };
+
+  void retire( Frame& frame );
+
+  Device& device;
+  VkBufferUsageFlags usage;
+  VkMemoryPropertyFlags properties;
+  std::vector< Frame > frames;
+};
+
+}  // namespace lve
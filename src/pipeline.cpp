@@ -1,6 +1,8 @@
 #include "pipeline.hpp"
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
@@ -9,17 +11,25 @@
 
 namespace lve {
 
+static std::atomic< uint32_t > nextPipelineId{ 0 };
+
 Pipeline::Pipeline(
     Device& _device, const std::string& vertFilePath,
     const std::string& fragFilePath, const PipelineConfigInfo& configInfo )
-    : device{ _device } {
+    : device{ _device }, id{ nextPipelineId++ } {
   createGraphicsPipeline( vertFilePath, fragFilePath, configInfo );
 }
 
 Pipeline::~Pipeline() {
   vkDestroyShaderModule( device.device(), vertShaderModule, nullptr );
   vkDestroyShaderModule( device.device(), fragShaderModule, nullptr );
-  vkDestroyPipeline( device.device(), graphicsPipeline, nullptr );
+
+  // the pipeline itself may still be bound in frames in flight
+  VkDevice owner = device.device();
+  VkPipeline pipeline = graphicsPipeline;
+  device.deferDestruction( [owner, pipeline]() {
+    vkDestroyPipeline( owner, pipeline, nullptr );
+  } );
 }
 
 std::vector< char > Pipeline::readFile( const std::string& filePath ) {
@@ -70,8 +80,8 @@ void Pipeline::createGraphicsPipeline(
   shaderStages[1].pNext = nullptr;
   shaderStages[1].pSpecializationInfo = nullptr;
 
-  auto bindingDescriptions = Model::Vertex::getBindingDescriptions();
-  auto attributeDescriptions = Model::Vertex::getAttributeDescriptions();
+  auto& bindingDescriptions = configInfo.bindingDescriptions;
+  auto& attributeDescriptions = configInfo.attributeDescriptions;
 
   VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
   vertexInputInfo.sType =
@@ -105,11 +115,20 @@ void Pipeline::createGraphicsPipeline(
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
   pipelineInfo.basePipelineIndex = -1;
 
+  // the pipeline cache lets the driver skip compiling shaders it has
+  // already seen, in this run or (since the cache is saved to disk) earlier
+  auto start = std::chrono::steady_clock::now();
+
   if ( vkCreateGraphicsPipelines(
-           device.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr,
+           device.device(), device.pipelineCache(), 1, &pipelineInfo, nullptr,
            &graphicsPipeline ) != VK_SUCCESS ) {
     throw std::runtime_error( "failed to create graphics pipeline" );
   }
+
+  device.recordPipelineCreation(
+      std::chrono::duration< double, std::milli >(
+          std::chrono::steady_clock::now() - start )
+          .count() );
 }
 
 void Pipeline::createShaderModule(
@@ -127,6 +146,9 @@ void Pipeline::createShaderModule(
 }
 
 void Pipeline::defaultPipelineConfigInfo( PipelineConfigInfo& configInfo ) {
+  configInfo.bindingDescriptions = Model::Vertex::getBindingDescriptions();
+  configInfo.attributeDescriptions = Model::Vertex::getAttributeDescriptions();
+
   configInfo.inputAssemblyInfo.sType =
       VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 
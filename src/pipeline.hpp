@@ -20,6 +20,9 @@ struct PipelineConfigInfo {
   VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
   std::vector< VkDynamicState > dynamicStateEnables;
   VkPipelineDynamicStateCreateInfo dynamicStateInfo;
+  // Model::Vertex layout by default
+  std::vector< VkVertexInputBindingDescription > bindingDescriptions;
+  std::vector< VkVertexInputAttributeDescription > attributeDescriptions;
   VkPipelineLayout pipelineLayout = nullptr;
   VkRenderPass renderPass = nullptr;
   uint32_t subpass = 0;
@@ -30,14 +33,13 @@ class Pipeline {
   // note: reference as member variable is unsafe, but acceptable here
   // since a pipeline must have a device to exist
   Device& device;
+  const uint32_t id;
 
   // vulkan objects - typedeffed pointers
   VkPipeline graphicsPipeline;
   VkShaderModule vertShaderModule;
   VkShaderModule fragShaderModule;
 
-  static std::vector< char > readFile( const std::string& );
-
   void createGraphicsPipeline(
       const std::string&, const std::string&, const PipelineConfigInfo& );
 
@@ -52,6 +54,10 @@ class Pipeline {
   Pipeline& operator=( const Pipeline& ) = delete;
 
   static void defaultPipelineConfigInfo( PipelineConfigInfo& );
+  // reads a whole file, e.g. SPIR-V code
+  static std::vector< char > readFile( const std::string& );
   void bind( VkCommandBuffer );
+  // unique among all pipelines created by the process, e.g. for sort keys
+  uint32_t getId() const { return id; }
 };
 }  // namespace lve
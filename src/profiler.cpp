@@ -0,0 +1,169 @@
+#include "profiler.hpp"
+
+// std headers
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace lve {
+
+Profiler::Profiler( Device& _device, uint32_t framesInFlight )
+    : device{ _device } {
+  QueueFamilyIndices indices = device.findPhysicalQueueFamilies();
+
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(
+      device.getPhysicalDevice(), &queueFamilyCount, nullptr );
+  std::vector< VkQueueFamilyProperties > queueFamilies( queueFamilyCount );
+  vkGetPhysicalDeviceQueueFamilyProperties(
+      device.getPhysicalDevice(), &queueFamilyCount, queueFamilies.data() );
+
+  uint32_t validBits = queueFamilies[indices.graphicsFamily].timestampValidBits;
+  supported = validBits > 0;
+  if ( !supported ) {
+    std::cout << "GPU timestamps not supported, profiler disabled"
+              << std::endl;
+    return;
+  }
+
+  // the upper bits of a timestamp are undefined if fewer than 64 are valid
+  timestampMask = validBits >= 64 ? ~0ull : ( 1ull << validBits ) - 1;
+  timestampPeriod = device.properties.limits.timestampPeriod;
+
+  frames.resize( framesInFlight );
+  for ( auto& frame: frames ) {
+    VkQueryPoolCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = MAX_QUERIES_PER_FRAME;
+
+    if ( vkCreateQueryPool(
+             device.device(), &createInfo, nullptr, &frame.queryPool ) !=
+         VK_SUCCESS ) {
+      throw std::runtime_error( "failed to create timestamp query pool!" );
+    }
+  }
+  results.resize( MAX_QUERIES_PER_FRAME );
+}
+
+Profiler::~Profiler() {
+  for ( auto& frame: frames ) {
+    vkDestroyQueryPool( device.device(), frame.queryPool, nullptr );
+  }
+}
+
+void Profiler::beginFrame( VkCommandBuffer commandBuffer, uint32_t frameIndex ) {
+  if ( !supported ) return;
+
+  currentFrame = &frames[frameIndex];
+  collect( *currentFrame );
+
+  // queries have to be reset before they can be written again
+  vkCmdResetQueryPool(
+      commandBuffer, currentFrame->queryPool, 0, MAX_QUERIES_PER_FRAME );
+  currentFrame->queryCount = 0;
+  currentFrame->scopes.clear();
+}
+
+uint32_t Profiler::beginScope(
+    VkCommandBuffer commandBuffer, const std::string& name ) {
+  if ( currentFrame == nullptr ||
+       currentFrame->queryCount + 2 > MAX_QUERIES_PER_FRAME ) {
+    return INVALID_SCOPE;
+  }
+
+  PendingScope scope{ name, currentFrame->queryCount++, INVALID_SCOPE };
+  vkCmdWriteTimestamp(
+      commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      currentFrame->queryPool, scope.beginQuery );
+
+  // reserve the end query right away, so that a scope that has started
+  // can always be closed
+  currentFrame->queryCount++;
+  currentFrame->scopes.push_back( scope );
+  return static_cast< uint32_t >( currentFrame->scopes.size() - 1 );
+}
+
+void Profiler::endScope( VkCommandBuffer commandBuffer, uint32_t scope ) {
+  if ( currentFrame == nullptr || scope == INVALID_SCOPE ) return;
+
+  PendingScope& pending = currentFrame->scopes[scope];
+  pending.endQuery = pending.beginQuery + 1;
+  vkCmdWriteTimestamp(
+      commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      currentFrame->queryPool, pending.endQuery );
+}
+
+void Profiler::collect( Frame& frame ) {
+  if ( frame.queryCount == 0 ) return;
+
+  // no VK_QUERY_RESULT_WAIT_BIT: if the GPU isn't done with the frame yet
+  // its timings are thrown away rather than waited for
+  VkResult result = vkGetQueryPoolResults(
+      device.device(), frame.queryPool, 0, frame.queryCount,
+      frame.queryCount * sizeof( uint64_t ), results.data(),
+      sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT );
+  if ( result != VK_SUCCESS ) {
+    droppedFrames++;
+    return;
+  }
+
+  for ( const auto& scope: frame.scopes ) {
+    if ( scope.endQuery == INVALID_SCOPE ) continue;
+
+    uint64_t begin = results[scope.beginQuery] & timestampMask;
+    uint64_t end = results[scope.endQuery] & timestampMask;
+    uint64_t ticks = ( end - begin ) & timestampMask;
+
+    double milliseconds =
+        static_cast< double >( ticks ) * timestampPeriod / 1000000.0;
+    scopeStats[scope.name].add( milliseconds );
+  }
+  collectedFrames++;
+}
+
+ProfilerScopeStats Profiler::makeStats(
+    const std::string& name, const RollingStats& rolling ) const {
+  ProfilerScopeStats stats{};
+  stats.name = name;
+  stats.samples = rolling.totalCount();
+  stats.lastMilliseconds = rolling.last();
+  stats.minMilliseconds = rolling.min();
+  stats.avgMilliseconds = rolling.average();
+  stats.p99Milliseconds = rolling.percentile( 99.0 );
+  return stats;
+}
+
+std::vector< ProfilerScopeStats > Profiler::getStats() const {
+  std::vector< ProfilerScopeStats > out;
+  for ( const auto& entry: scopeStats ) {
+    out.push_back( makeStats( entry.first, entry.second ) );
+  }
+  return out;
+}
+
+bool Profiler::getStats(
+    const std::string& name, ProfilerScopeStats& out ) const {
+  auto it = scopeStats.find( name );
+  if ( it == scopeStats.end() ) return false;
+
+  out = makeStats( it->first, it->second );
+  return true;
+}
+
+void Profiler::writeCsv( const std::string& path ) const {
+  std::ofstream file{ path, std::ios::trunc };
+  if ( !file ) {
+    std::cerr << "failed to write " << path << std::endl;
+    return;
+  }
+
+  file << "scope,samples,last_ms,min_ms,avg_ms,p99_ms\n";
+  for ( const auto& stats: getStats() ) {
+    file << stats.name << ',' << stats.samples << ','
+         << stats.lastMilliseconds << ',' << stats.minMilliseconds << ','
+         << stats.avgMilliseconds << ',' << stats.p99Milliseconds << '\n';
+  }
+}
+
+}  // namespace lve
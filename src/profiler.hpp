@@ -0,0 +1,110 @@
+#pragma once
+
+#include "device.hpp"
+#include "rolling_stats.hpp"
+
+// std lib headers
+#include <map>
+#include <string>
+#include <vector>
+
+namespace lve {
+
+struct ProfilerScopeStats {
+  std::string name;
+  uint64_t samples = 0;
+  double lastMilliseconds = 0.0;
+  double minMilliseconds = 0.0;
+  double avgMilliseconds = 0.0;
+  double p99Milliseconds = 0.0;
+};
+
+// GPU timings from timestamp queries. Every frame in flight gets its own
+// query pool; a frame's results are read back when its slot comes around
+// again, i.e. after the fence of that frame was waited for, so reading them
+// never stalls. Frames whose results still aren't available are dropped.
+//
+// Scopes are recorded into the command buffer with a timestamp at the
+// start and one at the end; scopes with the same name are aggregated
+class Profiler {
+ public:
+  static constexpr uint32_t MAX_QUERIES_PER_FRAME = 512;
+  static constexpr uint32_t INVALID_SCOPE = ~0u;
+
+  // writes the timestamps of a scope for as long as it lives
+  class Scope {
+   public:
+    Scope(
+        Profiler& _profiler, VkCommandBuffer _commandBuffer,
+        const std::string& name )
+        : profiler{ _profiler },
+          commandBuffer{ _commandBuffer },
+          index{ _profiler.beginScope( _commandBuffer, name ) } {}
+    ~Scope() { profiler.endScope( commandBuffer, index ); }
+    Scope( const Scope& ) = delete;
+    Scope& operator=( const Scope& ) = delete;
+
+   private:
+    Profiler& profiler;
+    VkCommandBuffer commandBuffer;
+    uint32_t index;
+  };
+
+  Profiler( Device& device, uint32_t framesInFlight );
+  ~Profiler();
+  Profiler( const Profiler& ) = delete;
+  Profiler& operator=( const Profiler& ) = delete;
+
+  // false if the graphics queue doesn't support timestamps; every call is a
+  // no-op then
+  bool isSupported() const { return supported; }
+
+  // starts recording the frame that uses slot frameIndex and collects the
+  // results of the previous frame in that slot. Has to be called outside of
+  // a render pass, once that previous frame's fence has been waited for
+  void beginFrame( VkCommandBuffer commandBuffer, uint32_t frameIndex );
+
+  // returns INVALID_SCOPE once the frame is out of queries
+  uint32_t beginScope( VkCommandBuffer commandBuffer, const std::string& name );
+  void endScope( VkCommandBuffer commandBuffer, uint32_t scope );
+
+  // rolling statistics of every scope seen so far, sorted by name
+  std::vector< ProfilerScopeStats > getStats() const;
+  bool getStats( const std::string& name, ProfilerScopeStats& out ) const;
+  uint64_t getCollectedFrames() const { return collectedFrames; }
+  uint64_t getDroppedFrames() const { return droppedFrames; }
+
+  void writeCsv( const std::string& path ) const;
+
+ private:
+  struct PendingScope {
+    std::string name;
+    uint32_t beginQuery;
+    uint32_t endQuery;
+  };
+
+  struct Frame {
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    uint32_t queryCount = 0;
+    std::vector< PendingScope > scopes;
+  };
+
+  void collect( Frame& frame );
+  ProfilerScopeStats makeStats(
+      const std::string& name, const RollingStats& rolling ) const;
+
+  Device& device;
+  bool supported = false;
+  // nanoseconds per tick
+  double timestampPeriod = 1.0;
+  uint64_t timestampMask = ~0ull;
+
+  std::vector< Frame > frames;
+  Frame* currentFrame = nullptr;
+  std::vector< uint64_t > results;
+  std::map< std::string, RollingStats > scopeStats;
+  uint64_t collectedFrames = 0;
+  uint64_t droppedFrames = 0;
+};
+
+}  // namespace lve
@@ -0,0 +1,84 @@
+#include "range_allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace lve {
+
+RangeAllocator::RangeAllocator( uint64_t capacity ) : capacity_{ capacity } {
+  reset();
+}
+
+void RangeAllocator::reset() {
+  freeRanges.clear();
+  if ( capacity_ > 0 ) freeRanges[0] = capacity_;
+  used = 0;
+}
+
+bool RangeAllocator::allocate(
+    uint64_t size, uint64_t alignment, uint64_t& offset ) {
+  assert( size > 0 && "Cannot allocate an empty range" );
+  if ( alignment == 0 ) alignment = 1;
+
+  for ( auto it = freeRanges.begin(); it != freeRanges.end(); ++it ) {
+    uint64_t start = it->first;
+    uint64_t rangeSize = it->second;
+    uint64_t aligned = ( start + alignment - 1 ) / alignment * alignment;
+    uint64_t padding = aligned - start;
+
+    if ( padding + size > rangeSize ) continue;
+
+    freeRanges.erase( it );
+
+    // whatever is left in front of (because of alignment) or behind the new
+    // range stays free
+    if ( padding > 0 ) freeRanges[start] = padding;
+    uint64_t tail = rangeSize - padding - size;
+    if ( tail > 0 ) freeRanges[aligned + size] = tail;
+
+    used += size;
+    offset = aligned;
+    return true;
+  }
+
+  return false;
+}
+
+void RangeAllocator::free( uint64_t offset, uint64_t size ) {
+  assert( offset + size <= capacity_ && "Range is outside of the allocator" );
+  assert( used >= size && "Freeing more than was allocated" );
+  used -= size;
+
+  auto next = freeRanges.lower_bound( offset );
+  assert(
+      ( next == freeRanges.end() || next->first >= offset + size ) &&
+      "Range is already free" );
+
+  // merge with the free range directly behind us
+  if ( next != freeRanges.end() && next->first == offset + size ) {
+    size += next->second;
+    next = freeRanges.erase( next );
+  }
+
+  // and with the one directly in front of us
+  if ( next != freeRanges.begin() ) {
+    auto previous = std::prev( next );
+    if ( previous->first + previous->second == offset ) {
+      previous->second += size;
+      return;
+    }
+  }
+
+  freeRanges[offset] = size;
+}
+
+uint64_t RangeAllocator::largestFreeRange() const {
+  uint64_t largest = 0;
+  for ( const auto& range: freeRanges ) {
+    largest = std::max( largest, range.second );
+  }
+  return largest;
+}
+
+}  // namespace lve
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+namespace lve {
+
+// hands out aligned [offset, offset + size) ranges from a fixed span. Free
+// ranges are kept sorted by offset so that neighbours can be merged back
+// together when something is released. The unit is up to the caller: the
+// memory allocator uses bytes, other users may count vertices or indices.
+class RangeAllocator {
+ public:
+  explicit RangeAllocator( uint64_t capacity );
+
+  // first fit; returns false if no free range is large enough
+  bool allocate( uint64_t size, uint64_t alignment, uint64_t& offset );
+  void free( uint64_t offset, uint64_t size );
+  void reset();
+
+  uint64_t capacity() const { return capacity_; }
+  uint64_t usedSize() const { return used; }
+  uint64_t largestFreeRange() const;
+  size_t freeRangeCount() const { return freeRanges.size(); }
+  bool empty() const { return used == 0; }
+
+ private:
+  uint64_t capacity_;
+  uint64_t used = 0;
+
+  // offset -> size
+  std::map< uint64_t, uint64_t > freeRanges;
+};
+
+}  // namespace lve
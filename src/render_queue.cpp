@@ -0,0 +1,54 @@
+#include "render_queue.hpp"
+
+// std headers
+#include <array>
+#include <cstring>
+
+namespace lve {
+
+uint64_t RenderQueue::makeKey(
+    uint32_t pipeline, uint32_t model, float depth ) {
+  // flip the bits of a float so that its unsigned integer order matches
+  // its numeric order: negative numbers get all bits flipped, positive
+  // ones only the sign bit
+  uint32_t depthBits;
+  std::memcpy( &depthBits, &depth, sizeof( depthBits ) );
+  depthBits = ( depthBits & 0x80000000u ) ? ~depthBits
+                                          : depthBits | 0x80000000u;
+
+  uint64_t pipelineBits = pipeline & ( ( 1u << PIPELINE_BITS ) - 1 );
+  uint64_t modelBits = model & ( ( 1u << MODEL_BITS ) - 1 );
+  return ( pipelineBits << ( 64 - PIPELINE_BITS ) ) | ( modelBits << 32 ) |
+         depthBits;
+}
+
+void RenderQueue::sort() {
+  if ( items.size() < 2 ) return;
+
+  // bits that differ between any two keys; passes over bytes without any
+  // are no-ops
+  uint64_t first = items[0].key;
+  uint64_t differing = 0;
+  for ( const auto& item: items ) differing |= item.key ^ first;
+
+  scratch.resize( items.size() );
+  for ( uint32_t shift = 0; shift < 64; shift += 8 ) {
+    if ( ( ( differing >> shift ) & 0xff ) == 0 ) continue;
+
+    std::array< size_t, 256 > offsets{};
+    for ( const auto& item: items ) offsets[( item.key >> shift ) & 0xff]++;
+
+    size_t offset = 0;
+    for ( auto& count: offsets ) {
+      size_t next = offset + count;
+      count = offset;
+      offset = next;
+    }
+
+    for ( const auto& item: items )
+      scratch[offsets[( item.key >> shift ) & 0xff]++] = item;
+    items.swap( scratch );
+  }
+}
+
+}  // namespace lve
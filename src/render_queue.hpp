@@ -0,0 +1,74 @@
+#pragma once
+
+// std lib headers
+#include <cstdint>
+#include <vector>
+
+namespace lve {
+
+// how many binds the recorder issued and how many it skipped because the
+// same pipeline or geometry pool index buffer was still bound, since the
+// queue was created. Models all live in the geometry pool, so its buffers
+// only need binding again for another index type
+struct RenderQueueStats {
+  uint64_t pipelineBinds = 0;
+  uint64_t pipelineBindsSkipped = 0;
+  uint64_t geometryBinds = 0;
+  uint64_t geometryBindsSkipped = 0;
+};
+
+// objects to draw this frame, each with a 64 bit key: the pipeline in the
+// top 8 bits, then 24 bits of model, then 32 bits of depth. Sorting by key
+// puts objects that share a pipeline next to each other, so the recorder
+// only has to bind a pipeline when the top bits change. The model bits no
+// longer decide any bind, they only keep draws of the same model together
+class RenderQueue {
+ public:
+  struct Item {
+    uint64_t key;
+    // index of the object in whatever the caller keeps its objects in
+    uint32_t object;
+  };
+
+  static constexpr uint32_t PIPELINE_BITS = 8;
+  static constexpr uint32_t MODEL_BITS = 24;
+
+  // ids wrap around past their bit width, which only costs binds. Depth
+  // sorts ascending, i.e. front to back for depth tested opaque objects
+  static uint64_t makeKey( uint32_t pipeline, uint32_t model, float depth );
+  static uint32_t pipelineOf( uint64_t key ) {
+    return static_cast< uint32_t >( key >> ( 64 - PIPELINE_BITS ) );
+  }
+  static uint32_t modelOf( uint64_t key ) {
+    return static_cast< uint32_t >( key >> 32 ) &
+           ( ( 1u << MODEL_BITS ) - 1 );
+  }
+
+  void clear() { items.clear(); }
+  void submit( uint64_t key, uint32_t object ) {
+    items.push_back( { key, object } );
+  }
+  // stable LSD radix sort over the bytes of the keys; bytes that are the
+  // same in every key are skipped, so a frame with few distinct pipelines
+  // and models and no depth only pays for a few passes
+  void sort();
+  const std::vector< Item >& getItems() const { return items; }
+
+  // the recorder reports what it did with every item, so that the elision
+  // can be checked on real scenes
+  void countPipelineBind( bool skipped ) {
+    skipped ? stats.pipelineBindsSkipped++ : stats.pipelineBinds++;
+  }
+  void countGeometryBind( bool skipped ) {
+    skipped ? stats.geometryBindsSkipped++ : stats.geometryBinds++;
+  }
+  const RenderQueueStats& getStats() const { return stats; }
+
+ private:
+  std::vector< Item > items;
+  // kept between frames to reuse the memory
+  std::vector< Item > scratch;
+  RenderQueueStats stats;
+};
+
+}  // namespace lve
@@ -0,0 +1,93 @@
+#pragma once
+
+// std lib headers
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace lve {
+
+// keeps the most recent samples of a measurement (a frame time, a GPU pass)
+// and answers min/avg/percentile queries over just those, so that numbers
+// follow what the app is doing right now instead of averaging in startup
+class RollingStats {
+ public:
+  static constexpr size_t DEFAULT_WINDOW = 240;
+
+  explicit RollingStats( size_t window = DEFAULT_WINDOW ) : window{ window } {
+    samples.reserve( window );
+  }
+
+  void add( double value ) {
+    if ( samples.size() < window ) {
+      samples.push_back( value );
+    } else {
+      samples[next] = value;
+    }
+    next = ( next + 1 ) % window;
+    last_ = value;
+    total++;
+  }
+
+  void clear() {
+    samples.clear();
+    next = 0;
+    last_ = 0.0;
+    total = 0;
+  }
+
+  // samples currently in the window
+  size_t count() const { return samples.size(); }
+  // samples ever added
+  uint64_t totalCount() const { return total; }
+  double last() const { return last_; }
+
+  double min() const {
+    if ( samples.empty() ) return 0.0;
+    return *std::min_element( samples.begin(), samples.end() );
+  }
+
+  double max() const {
+    if ( samples.empty() ) return 0.0;
+    return *std::max_element( samples.begin(), samples.end() );
+  }
+
+  double average() const {
+    if ( samples.empty() ) return 0.0;
+    return std::accumulate( samples.begin(), samples.end(), 0.0 ) /
+           static_cast< double >( samples.size() );
+  }
+
+  double variance() const {
+    if ( samples.empty() ) return 0.0;
+    double avg = average();
+    double sum = 0.0;
+    for ( double sample: samples ) sum += ( sample - avg ) * ( sample - avg );
+    return sum / static_cast< double >( samples.size() );
+  }
+
+  // nearest rank percentile, p in [0, 100]
+  double percentile( double p ) const {
+    if ( samples.empty() ) return 0.0;
+
+    std::vector< double > sorted = samples;
+    size_t rank = static_cast< size_t >(
+        std::ceil( p / 100.0 * static_cast< double >( sorted.size() ) ) );
+    rank = std::min( std::max( rank, size_t( 1 ) ), sorted.size() ) - 1;
+
+    std::nth_element( sorted.begin(), sorted.begin() + rank, sorted.end() );
+    return sorted[rank];
+  }
+
+ private:
+  size_t window;
+  std::vector< double > samples;
+  size_t next = 0;
+  double last_ = 0.0;
+  uint64_t total = 0;
+};
+
+}  // namespace lve
@@ -3,13 +3,24 @@
 layout( location = 0 ) in vec2 position;
 layout( location = 1 ) in vec3 color;
 
-layout( push_constant ) uniform Push {
-  mat2 transform;
+layout( location = 0 ) out vec3 fragColor;
+
+// see ObjectData in first_app.cpp
+struct ObjectData {
+  // columns of the 2x2 transform
+  vec4 transform;
   vec2 offset;
-  vec3 color;
-} push;
+  vec4 color;
+};
+
+layout( std430, set = 0, binding = 0 ) readonly buffer Objects {
+  ObjectData objects[];
+};
 
+// every object is drawn with its index in the buffer as firstInstance
 void main() {
-  gl_Position = vec4( push.transform * position + push.offset, 0.0, 1.0 );
+  ObjectData object = objects[gl_InstanceIndex];
+  mat2 transform = mat2( object.transform.xy, object.transform.zw );
+  gl_Position = vec4( transform * position + object.offset, 0.0, 1.0 );
+  fragColor = object.color.rgb;
 }
-
@@ -0,0 +1,16 @@
+#version 450
+
+layout( location = 0 ) in vec2 position;
+layout( location = 1 ) in vec3 color;
+
+// per instance, see Model::Instance
+layout( location = 2 ) in mat2 transform;
+layout( location = 4 ) in vec2 offset;
+layout( location = 5 ) in vec3 instanceColor;
+
+layout( location = 0 ) out vec3 fragColor;
+
+void main() {
+  gl_Position = vec4( transform * position + offset, 0.0, 1.0 );
+  fragColor = instanceColor;
+}
@@ -0,0 +1,255 @@
+#include "sierpinski.hpp"
+
+// std headers
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace lve {
+
+namespace {
+
+// below this many groups per thread, starting threads costs more than the
+// work they take over
+constexpr size_t MIN_GROUPS_PER_THREAD = 16384;
+
+// every corner of a split triangle gets the same color, whatever the path
+const glm::vec3 CORNER_COLORS[3] = {
+  { 0.f, 0.5f, 0.5f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f, 1.f } };
+
+// the last split turns a triangle with corners P, P + 2s e1 and P + 2s e2
+// into three, whose corners are P plus one of these multiples of s e1 and
+// s e2; the rest of the path only decides where P is
+const int OFFSETS[6][2] = {
+  { 0, 0 }, { 1, 0 }, { 0, 1 }, { 2, 0 }, { 1, 1 }, { 0, 2 } };
+// which of them each of the nine corners is, three per triangle
+const int CORNER_OFFSETS[9] = { 0, 1, 2, 1, 3, 4, 2, 4, 5 };
+
+#ifdef __SSE2__
+void storeLow( Model::Vertex& vertex, __m128 pair ) {
+  _mm_storel_pi( reinterpret_cast< __m64* >( &vertex.position ), pair );
+}
+void storeHigh( Model::Vertex& vertex, __m128 pair ) {
+  _mm_storeh_pi( reinterpret_cast< __m64* >( &vertex.position ), pair );
+}
+#endif
+
+// fills groups [first, last): a group are the three triangles of one last
+// split, so there are 3^(depth - 1) of them per input triangle
+void writeGroups(
+    unsigned char depth, const Model::Triangle* triangles, size_t first,
+    size_t last, Model::Vertex* out ) {
+  size_t groupsPerTriangle = sierpinskiTriangleCount( depth - 1 );
+  size_t triangle = first / groupsPerTriangle;
+  size_t group = first % groupsPerTriangle;
+
+  // the path of the first group, one base 3 digit per split above the last
+  // one, most significant first. u and v are how far P lies along the edges
+  // ab and ac as fractions of them; sums of distinct powers of two, so
+  // they stay exact however they are updated
+  unsigned char digits[SIERPINSKI_MAX_DEPTH] = {};
+  float steps[SIERPINSKI_MAX_DEPTH] = {};
+  float u = 0.f;
+  float v = 0.f;
+  for ( int level = depth - 1; level >= 1; level-- ) {
+    steps[level] = std::ldexp( 1.f, -level );
+    digits[level] = static_cast< unsigned char >( group % 3 );
+    group /= 3;
+    if ( digits[level] == 1 ) u += steps[level];
+    if ( digits[level] == 2 ) v += steps[level];
+  }
+  float size = std::ldexp( 1.f, -depth );
+
+  // every corner is a + U e1 + V e2 with U and V exact as well, so a corner
+  // that several triangles share comes out bit for bit the same in each of
+  // them, which is what welding needs
+#ifdef __SSE2__
+  // two corners per register, see CORNER_OFFSETS for which is where
+  __m128 u01 = _mm_setr_ps( 0.f, 0.f, size, size );
+  __m128 v01 = _mm_setzero_ps();
+  __m128 u23 = _mm_setr_ps( 0.f, 0.f, 2.f * size, 2.f * size );
+  __m128 v23 = _mm_setr_ps( size, size, 0.f, 0.f );
+  __m128 u45 = _mm_setr_ps( size, size, 0.f, 0.f );
+  __m128 v45 = _mm_setr_ps( size, size, 2.f * size, 2.f * size );
+#endif
+
+  for ( size_t i = first; i < last; ) {
+    const Model::Triangle& root = triangles[triangle];
+    glm::vec2 a = root.a.position;
+    glm::vec2 e1 = root.b.position - a;
+    glm::vec2 e2 = root.c.position - a;
+#ifdef __SSE2__
+    __m128 origin = _mm_setr_ps( a.x, a.y, a.x, a.y );
+    __m128 edge1 = _mm_setr_ps( e1.x, e1.y, e1.x, e1.y );
+    __m128 edge2 = _mm_setr_ps( e2.x, e2.y, e2.x, e2.y );
+    auto corners = [&]( __m128 uOffsets, __m128 vOffsets ) {
+      __m128 cornerU = _mm_add_ps( _mm_set1_ps( u ), uOffsets );
+      __m128 cornerV = _mm_add_ps( _mm_set1_ps( v ), vOffsets );
+      return _mm_add_ps(
+          origin, _mm_add_ps(
+                      _mm_mul_ps( cornerU, edge1 ),
+                      _mm_mul_ps( cornerV, edge2 ) ) );
+    };
+#endif
+
+    // the groups of this input triangle, or as many as are left
+    for ( ; i < last; i++ ) {
+      Model::Vertex* vertices = out + i * 9;
+
+#ifdef __SSE2__
+      __m128 p01 = corners( u01, v01 );
+      __m128 p23 = corners( u23, v23 );
+      __m128 p45 = corners( u45, v45 );
+      storeLow( vertices[0], p01 );
+      storeHigh( vertices[1], p01 );
+      storeLow( vertices[2], p23 );
+      storeHigh( vertices[3], p01 );
+      storeHigh( vertices[4], p23 );
+      storeLow( vertices[5], p45 );
+      storeLow( vertices[6], p23 );
+      storeLow( vertices[7], p45 );
+      storeHigh( vertices[8], p45 );
+#else
+      for ( int j = 0; j < 9; j++ ) {
+        const int* offset = OFFSETS[CORNER_OFFSETS[j]];
+        float cornerU = u + offset[0] * size;
+        float cornerV = v + offset[1] * size;
+        vertices[j].position = a + ( cornerU * e1 + cornerV * e2 );
+      }
+#endif
+      for ( int j = 0; j < 9; j++ ) vertices[j].color = CORNER_COLORS[j % 3];
+
+      // next path: count up in base 3 from the last digit, moving u and v
+      // along with every digit that changes
+      int level = depth - 1;
+      for ( ; level >= 1; level-- ) {
+        unsigned char& digit = digits[level];
+        if ( digit == 0 ) {
+          u += steps[level];
+        } else if ( digit == 1 ) {
+          u -= steps[level];
+          v += steps[level];
+        } else {
+          v -= steps[level];
+        }
+        digit = ( digit + 1 ) % 3;
+        if ( digit != 0 ) break;
+      }
+      // every digit wrapped around: on to the next input triangle
+      if ( level == 0 ) {
+        triangle++;
+        i++;
+        break;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+size_t sierpinskiTriangleCount( unsigned char depth, size_t triangleCount ) {
+  size_t count = triangleCount;
+  for ( unsigned char i = 0; i < depth; i++ ) count *= 3;
+  return count;
+}
+
+void sierpinski(
+    unsigned char depth, const Model::Triangle* triangles, size_t count,
+    Model::Vertex* out, uint32_t threadCount ) {
+  // the paths are kept in arrays of this size
+  if ( depth > SIERPINSKI_MAX_DEPTH )
+    throw std::runtime_error( "sierpinski depth is too large!" );
+  if ( depth == 0 ) {
+    for ( size_t i = 0; i < count; i++ ) {
+      out[3 * i] = triangles[i].a;
+      out[3 * i + 1] = triangles[i].b;
+      out[3 * i + 2] = triangles[i].c;
+    }
+    return;
+  }
+
+  size_t groups = sierpinskiTriangleCount( depth - 1, count );
+  if ( groups < 2 * MIN_GROUPS_PER_THREAD ) {
+    writeGroups( depth, triangles, 0, groups, out );
+    return;
+  }
+
+  // asking for the core count reads it from the system every time
+  static const uint32_t cores =
+      std::max( std::thread::hardware_concurrency(), 1u );
+  if ( threadCount == 0 ) threadCount = cores;
+  size_t chunks =
+      std::min( size_t( threadCount ), groups / MIN_GROUPS_PER_THREAD );
+
+  // every chunk writes its own range of out, so they need no
+  // synchronization besides the joins; the calling thread takes the last
+  std::vector< std::thread > workers;
+  size_t chunkSize = ( groups + chunks - 1 ) / chunks;
+  for ( size_t first = 0; first + chunkSize < groups; first += chunkSize ) {
+    workers.emplace_back(
+        writeGroups, depth, triangles, first, first + chunkSize, out );
+  }
+  writeGroups(
+      depth, triangles, workers.size() * chunkSize, groups, out );
+  for ( auto& worker: workers ) worker.join();
+}
+
+std::vector< Model::Vertex > sierpinski(
+    unsigned char depth, const std::vector< Model::Triangle >& triangles ) {
+  std::vector< Model::Vertex > vertices(
+      sierpinskiTriangleCount( depth, triangles.size() ) * 3 );
+  sierpinski( depth, triangles.data(), triangles.size(), vertices.data() );
+  return vertices;
+}
+
+std::vector< Model::Triangle > sierpinskiSplit( Model::Triangle t ) {
+  float ax = t.a.position.x;
+  float ay = t.a.position.y;
+  float bx = t.b.position.x;
+  float by = t.b.position.y;
+  float cx = t.c.position.x;
+  float cy = t.c.position.y;
+
+  // calculate midpoints
+  float abx = ( ax + bx ) / 2;
+  float aby = ( ay + by ) / 2;
+  float bcx = ( bx + cx ) / 2;
+  float bcy = ( by + cy ) / 2;
+  float cax = ( cx + ax ) / 2;
+  float cay = ( cy + ay ) / 2;
+
+  return std::vector< Model::Triangle >{
+    { { { ax, ay }, { 0.f, 0.5f, 0.5f } },
+      { { abx, aby }, { 0.f, 1.f, 0.f } },
+      { { cax, cay }, { 0.f, 0.f, 1.f } } },
+    { { { abx, aby }, { 0.f, 0.5f, 0.5f } },
+      { { bx, by }, { 0.f, 1.f, 0.f } },
+      { { bcx, bcy }, { 0.f, 0.f, 1.f } } },
+    { { { cax, cay }, { 0.f, 0.5f, 0.5f } },
+      { { bcx, bcy }, { 0.f, 1.f, 0.f } },
+      { { cx, cy }, { 0.f, 0.f, 1.f } } }
+  };
+}
+
+std::vector< Model::Triangle > sierpinskiRecursive(
+    unsigned char depth, std::vector< Model::Triangle > triangles ) {
+  if ( depth == 0 ) return triangles;
+
+  // this allocates a bunch of memory just to keep the original triangles out of
+  // the final set
+  std::vector< Model::Triangle > out;
+
+  for ( auto triangle: triangles ) {
+    std::vector< Model::Triangle > newTriangles = sierpinskiSplit( triangle );
+    out.insert( out.begin(), newTriangles.begin(), newTriangles.end() );
+  }
+
+  return sierpinskiRecursive( depth - 1, out );
+}
+
+}  // namespace lve
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "model.hpp"
+
+// std lib headers
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lve {
+
+// the deepest sierpinski() goes, it throws beyond; 3^20 triangles are more
+// than fit in memory anyway, and the math is exact up to there
+constexpr unsigned char SIERPINSKI_MAX_DEPTH = 20;
+
+// 3^depth for every triangle that is split
+size_t sierpinskiTriangleCount( unsigned char depth, size_t triangleCount = 1 );
+
+// splits every triangle depth times and writes the 3^depth triangles of each
+// to out as a triangle list, three vertices per triangle, in the order the
+// recursion would visit them. Each triangle is computed from its index: its
+// base 3 digits are the path of corners taken from the root, which places
+// it without any recursion. Nothing is allocated, so out may be mapped
+// memory; it has to hold sierpinskiTriangleCount( depth, count ) * 3
+// vertices. Large outputs are split into chunks that are filled in
+// parallel, threadCount 0 uses every core
+void sierpinski(
+    unsigned char depth, const Model::Triangle* triangles, size_t count,
+    Model::Vertex* out, uint32_t threadCount = 0 );
+// the same, into a new vector
+std::vector< Model::Vertex > sierpinski(
+    unsigned char depth, const std::vector< Model::Triangle >& triangles );
+
+// the recursive implementation the above replaced, which builds a new
+// vector per level and prepends to it. Only kept to compare against, see
+// sierpinski_bench.cpp
+std::vector< Model::Triangle > sierpinskiRecursive(
+    unsigned char depth, std::vector< Model::Triangle > triangles );
+// the three corner triangles of t, leaving out the middle one
+std::vector< Model::Triangle > sierpinskiSplit( Model::Triangle t );
+
+}  // namespace lve
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "sierpinski.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const std::vector< lve::Model::Triangle > ROOT{
+  { { { 0.f, -0.5f }, { 0.f, 0.5f, 0.5f } },
+    { { 0.5f, 0.8f }, { 0.f, 1.f, 0.f } },
+    { { -0.7f, 0.5f }, { 0.f, 0.f, 1.f } } } };
+
+// best of runs, in milliseconds
+template < typename F >
+double bestOf( uint32_t runs, F&& f ) {
+  double best = INFINITY;
+  for ( uint32_t i = 0; i < runs; i++ ) {
+    auto start = Clock::now();
+    f();
+    std::chrono::duration< double, std::milli > elapsed = Clock::now() - start;
+    best = std::min( best, elapsed.count() );
+  }
+  return best;
+}
+
+// the implementations differ in the order of the triangles and in rounding,
+// so both are sorted by a key that is exact for either: the corner a as
+// multiples of the smallest triangle's size along the root's edges
+using Key = std::array< long, 2 >;
+
+Key keyOf( glm::vec2 position, unsigned char depth ) {
+  glm::vec2 a = ROOT[0].a.position;
+  glm::vec2 e1 = ROOT[0].b.position - a;
+  glm::vec2 e2 = ROOT[0].c.position - a;
+  glm::vec2 p = position - a;
+  // solve p = u e1 + v e2
+  float determinant = e1.x * e2.y - e1.y * e2.x;
+  float u = ( p.x * e2.y - p.y * e2.x ) / determinant;
+  float v = ( e1.x * p.y - e1.y * p.x ) / determinant;
+  float scale = std::ldexp( 1.f, depth );
+  return { std::lround( u * scale ), std::lround( v * scale ) };
+}
+
+bool matches(
+    unsigned char depth, const std::vector< lve::Model::Triangle >& expected,
+    const std::vector< lve::Model::Vertex >& vertices ) {
+  if ( vertices.size() != expected.size() * 3 ) return false;
+
+  std::vector< std::pair< Key, const lve::Model::Vertex* > > a, b;
+  for ( const auto& triangle: expected )
+    a.push_back( { keyOf( triangle.a.position, depth ), &triangle.a } );
+  for ( size_t i = 0; i < vertices.size(); i += 3 )
+    b.push_back( { keyOf( vertices[i].position, depth ), &vertices[i] } );
+  auto byKey = []( const auto& x, const auto& y ) { return x.first < y.first; };
+  std::sort( a.begin(), a.end(), byKey );
+  std::sort( b.begin(), b.end(), byKey );
+
+  for ( size_t i = 0; i < a.size(); i++ ) {
+    if ( a[i].first != b[i].first ) return false;
+    for ( int j = 0; j < 3; j++ ) {
+      const lve::Model::Vertex& x = a[i].second[j];
+      const lve::Model::Vertex& y = b[i].second[j];
+      glm::vec2 error = x.position - y.position;
+      if ( std::abs( error.x ) > 1e-5f || std::abs( error.y ) > 1e-5f ||
+           x.color != y.color )
+        return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+// times the iterative generator against the recursive one it replaced, for
+// every depth up to --depth. The recursive one prepends to a vector per
+// triangle, so it only runs up to --reference-depth; where both run, their
+// output is compared too
+int main( int argc, char** argv ) {
+  uint32_t depth = 10;
+  uint32_t referenceDepth = 8;
+  uint32_t threads = 0;
+  uint32_t runs = 5;
+
+  for ( int i = 1; i < argc; i++ ) {
+    bool hasValue = i + 1 < argc;
+    if ( strcmp( argv[i], "--depth" ) == 0 && hasValue ) {
+      depth = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--reference-depth" ) == 0 && hasValue ) {
+      referenceDepth = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--threads" ) == 0 && hasValue ) {
+      threads = static_cast< uint32_t >( std::atoi( argv[++i] ) );
+    } else if ( strcmp( argv[i], "--runs" ) == 0 && hasValue ) {
+      runs = std::max( static_cast< uint32_t >( std::atoi( argv[++i] ) ), 1u );
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--depth D] [--reference-depth D] [--threads N]"
+                   " [--runs N]"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if ( depth > lve::SIERPINSKI_MAX_DEPTH ) {
+    std::cerr << "depth is at most " << int( lve::SIERPINSKI_MAX_DEPTH )
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::setw( 6 ) << "depth" << std::setw( 12 ) << "triangles"
+            << std::setw( 14 ) << "recursive ms" << std::setw( 14 )
+            << "iterative ms" << std::setw( 10 ) << "speedup"
+            << std::setw( 8 ) << "match" << std::endl;
+
+  bool allMatch = true;
+  for ( uint32_t d = 1; d <= depth; d++ ) {
+    auto level = static_cast< unsigned char >( d );
+    size_t triangles = lve::sierpinskiTriangleCount( level );
+
+    // preallocated once, like a mapped buffer would be
+    std::vector< lve::Model::Vertex > vertices( triangles * 3 );
+    double iterative = bestOf( runs, [&]() {
+      lve::sierpinski( level, ROOT.data(), ROOT.size(), vertices.data(),
+                       threads );
+    } );
+
+    std::cout << std::setw( 6 ) << d << std::setw( 12 ) << triangles
+              << std::fixed << std::setprecision( 3 );
+    if ( d <= referenceDepth ) {
+      std::vector< lve::Model::Triangle > expected;
+      double recursive = bestOf( runs, [&]() {
+        expected = lve::sierpinskiRecursive( level, ROOT );
+      } );
+      bool match = matches( level, expected, vertices );
+      allMatch = allMatch && match;
+      std::cout << std::setw( 14 ) << recursive << std::setw( 14 ) << iterative
+                << std::setw( 9 ) << recursive / iterative << "x"
+                << std::setw( 8 ) << ( match ? "yes" : "NO" );
+    } else {
+      std::cout << std::setw( 14 ) << "-" << std::setw( 14 ) << iterative
+                << std::setw( 10 ) << "-" << std::setw( 8 ) << "-";
+    }
+    std::cout << std::endl;
+  }
+
+  return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
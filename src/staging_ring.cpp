@@ -0,0 +1,66 @@
+#include "staging_ring.hpp"
+
+#include <cassert>
+
+namespace lve {
+
+StagingRing::StagingRing(
+    VkBuffer _buffer, void* _mapped, VkDeviceSize _size )
+    : buffer{ _buffer },
+      mapped{ static_cast< char* >( _mapped ) },
+      size{ _size } {}
+
+bool StagingRing::allocate(
+    VkDeviceSize regionSize, VkDeviceSize alignment, StagingRegion& region ) {
+  assert( regionSize <= size && "Staging region larger than the ring" );
+  if ( alignment == 0 ) alignment = 1;
+
+  uint64_t start = head;
+  uint64_t physical = start % size;
+  uint64_t aligned = ( physical + alignment - 1 ) / alignment * alignment;
+
+  // a region never wraps around the end of the buffer; skip to the start of
+  // the buffer instead and waste the bytes at the end
+  if ( aligned + regionSize > size ) {
+    start += size - physical;
+    physical = 0;
+    aligned = 0;
+  }
+
+  uint64_t end = start + ( aligned - physical ) + regionSize;
+  if ( end - tail > size ) return false;
+
+  head = end;
+
+  region.buffer = buffer;
+  region.offset = aligned;
+  region.size = regionSize;
+  region.data = mapped + aligned;
+  return true;
+}
+
+void StagingRing::close( uint64_t submission ) {
+  if ( !inFlight.empty() && inFlight.back().position == head ) {
+    // nothing new was written since the last submission, but the space is
+    // still only safe to reuse once the newest submission is done
+    inFlight.back().submission = submission;
+    return;
+  }
+  inFlight.push_back( { submission, head } );
+}
+
+void StagingRing::release( uint64_t completedSubmission ) {
+  while ( !inFlight.empty() &&
+          inFlight.front().submission <= completedSubmission ) {
+    tail = inFlight.front().position;
+    inFlight.pop_front();
+  }
+
+  // nothing outstanding; start over at the beginning so big regions don't
+  // have to wrap
+  if ( inFlight.empty() && tail == head ) {
+    head = tail = 0;
+  }
+}
+
+}  // namespace lve
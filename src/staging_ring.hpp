@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// std lib headers
+#include <deque>
+
+namespace lve {
+
+// a slice of the staging buffer that the CPU may write to until it has been
+// submitted
+struct StagingRegion {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  void* data = nullptr;
+};
+
+// bookkeeping for a persistently mapped staging buffer that is used as a ring.
+// Space is handed out at the head; each submission that reads from the ring
+// marks everything written so far with its submission number, and the tail
+// only moves forward once that submission is known to be finished on the GPU.
+//
+// Positions are kept as ever-increasing byte counts, the physical offset in
+// the buffer is the position modulo the ring size.
+class StagingRing {
+ public:
+  StagingRing( VkBuffer, void* mapped, VkDeviceSize size );
+  StagingRing( const StagingRing& ) = delete;
+  StagingRing& operator=( const StagingRing& ) = delete;
+
+  // returns false if there is currently not enough free space; the caller
+  // should wait for an earlier submission and release() before trying again
+  bool allocate( VkDeviceSize size, VkDeviceSize alignment, StagingRegion& );
+
+  // everything allocated since the last close belongs to this submission
+  void close( uint64_t submission );
+
+  // give back the space of every submission up to and including this one
+  void release( uint64_t completedSubmission );
+
+  VkDeviceSize capacity() const { return size; }
+  VkDeviceSize usedSize() const { return head - tail; }
+
+ private:
+  struct Fence {
+    uint64_t submission;
+    uint64_t position;
+  };
+
+  VkBuffer buffer;
+  char* mapped;
+  VkDeviceSize size;
+
+  uint64_t head = 0;
+  uint64_t tail = 0;
+  std::deque< Fence > inFlight;
+};
+
+}  // namespace lve
@@ -1,6 +1,7 @@
 #include "swap_chain.hpp"
 
 // std
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <cstring>
@@ -11,15 +12,19 @@
 
 namespace lve {
 
-SwapChain::SwapChain( Device &deviceRef, VkExtent2D extent )
-    : device{ deviceRef }, windowExtent{ extent } {
+SwapChain::SwapChain(
+    Device &deviceRef, VkExtent2D extent, SwapChainSettings _settings )
+    : device{ deviceRef }, windowExtent{ extent }, settings{ _settings } {
   init();
 }
 
 SwapChain::SwapChain(
     Device &deviceRef, VkExtent2D extent,
-    std::shared_ptr< SwapChain > previous )
-    : device{ deviceRef }, windowExtent{ extent }, oldSwapChain{ previous } {
+    std::shared_ptr< SwapChain > previous, SwapChainSettings _settings )
+    : device{ deviceRef },
+      windowExtent{ extent },
+      settings{ _settings },
+      oldSwapChain{ previous } {
   init();
 
   // clean up old swap chain
@@ -27,40 +32,85 @@ SwapChain::SwapChain(
 }
 
 SwapChain::~SwapChain() {
-  for ( auto imageView: swapChainImageViews ) {
-    vkDestroyImageView( device.device(), imageView, nullptr );
-  }
-  swapChainImageViews.clear();
-
-  if ( swapChain != nullptr ) {
-    vkDestroySwapchainKHR( device.device(), swapChain, nullptr );
-    swapChain = nullptr;
-  }
-
-  for ( int i = 0; i < depthImages.size(); i++ ) {
-    vkDestroyImageView( device.device(), depthImageViews[i], nullptr );
-    vkDestroyImage( device.device(), depthImages[i], nullptr );
-    vkFreeMemory( device.device(), depthImageMemorys[i], nullptr );
-  }
-
-  for ( auto framebuffer: swapChainFramebuffers ) {
-    vkDestroyFramebuffer( device.device(), framebuffer, nullptr );
-  }
-
-  vkDestroyRenderPass( device.device(), renderPass, nullptr );
-
-  // cleanup synchronization objects
-  for ( size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
-    vkDestroySemaphore( device.device(), renderFinishedSemaphores[i], nullptr );
-    vkDestroySemaphore( device.device(), imageAvailableSemaphores[i], nullptr );
-    vkDestroyFence( device.device(), inFlightFences[i], nullptr );
-  }
+  // a swap chain is usually replaced while frames that render into it are
+  // still in flight; everything is destroyed once those are done. Sync
+  // objects that were handed over to a newer swap chain are gone from here
+  Device &owner = device;
+  device.deferDestruction(
+      [&owner, imageViews = std::move( swapChainImageViews ),
+       swapChain = swapChain, images = std::move( swapChainImages ),
+       offscreenAllocations = std::move( offscreenImageAllocations ),
+       depthImages = std::move( depthImages ),
+       depthAllocations = std::move( depthImageAllocations ),
+       depthImageViews = std::move( depthImageViews ),
+       framebuffers = std::move( swapChainFramebuffers ),
+       renderPass = renderPass,
+       imageAvailable = std::move( imageAvailableSemaphores ),
+       renderFinished = std::move( renderFinishedSemaphores ),
+       fences = std::move( inFlightFences )]() mutable {
+        VkDevice device = owner.device();
+
+        for ( auto imageView: imageViews ) {
+          vkDestroyImageView( device, imageView, nullptr );
+        }
+
+        if ( swapChain != nullptr ) {
+          vkDestroySwapchainKHR( device, swapChain, nullptr );
+        }
+
+        for ( size_t i = 0; i < offscreenAllocations.size(); i++ ) {
+          vkDestroyImage( device, images[i], nullptr );
+          owner.freeMemory( offscreenAllocations[i] );
+        }
+
+        for ( size_t i = 0; i < depthImages.size(); i++ ) {
+          vkDestroyImageView( device, depthImageViews[i], nullptr );
+          vkDestroyImage( device, depthImages[i], nullptr );
+          owner.freeMemory( depthAllocations[i] );
+        }
+
+        for ( auto framebuffer: framebuffers ) {
+          vkDestroyFramebuffer( device, framebuffer, nullptr );
+        }
+
+        vkDestroyRenderPass( device, renderPass, nullptr );
+
+        // cleanup synchronization objects
+        for ( size_t i = 0; i < fences.size(); i++ ) {
+          vkDestroySemaphore( device, renderFinished[i], nullptr );
+          vkDestroySemaphore( device, imageAvailable[i], nullptr );
+          vkDestroyFence( device, fences[i], nullptr );
+        }
+      } );
 }
 
 VkResult SwapChain::acquireNextImage( uint32_t *imageIndex ) {
+  using clock = std::chrono::steady_clock;
+  using milliseconds = std::chrono::duration< double, std::milli >;
+
+  timings = SwapChainTimings{};
+  auto waitStart = clock::now();
   vkWaitForFences(
       device.device(), 1, &inFlightFences[currentFrame], VK_TRUE,
       std::numeric_limits< uint64_t >::max() );
+  timings.acquireFenceWait = milliseconds( clock::now() - waitStart ).count();
+  device.frameCompleted( frameNumbers[currentFrame] );
+
+  // without present timing the closest thing to a present time is when the
+  // frame was seen to be done, which is an upper bound of when its rendering
+  // finished
+  if ( !measuresPresentTime() && frameNumbers[currentFrame] != 0 ) {
+    latencySamples.push_back(
+        milliseconds( clock::now() - submitTimes[currentFrame] ).count() );
+  }
+
+  // offscreen images are simply used round robin; submitCommandBuffers waits
+  // for the frame that last rendered into the image
+  if ( device.isHeadless() ) {
+    *imageIndex = nextOffscreenImage;
+    nextOffscreenImage = ( nextOffscreenImage + 1 ) % imageCount();
+    return VK_SUCCESS;
+  }
 
   VkResult result = vkAcquireNextImageKHR(
       device.device(), swapChain, std::numeric_limits< uint64_t >::max(),
@@ -73,20 +123,29 @@ VkResult SwapChain::acquireNextImage( uint32_t *imageIndex ) {
 
 VkResult SwapChain::submitCommandBuffers(
     const VkCommandBuffer *buffers, uint32_t *imageIndex ) {
+  using clock = std::chrono::steady_clock;
+  using milliseconds = std::chrono::duration< double, std::milli >;
+
   if ( imagesInFlight[*imageIndex] != VK_NULL_HANDLE ) {
+    auto waitStart = clock::now();
     vkWaitForFences(
         device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX );
+    timings.submitFenceWait = milliseconds( clock::now() - waitStart ).count();
   }
   imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
+  // nothing is acquired or presented when headless, so there are no
+  // semaphores to wait on or signal
+  bool headless = device.isHeadless();
+
   VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
   VkPipelineStageFlags waitStages[] = {
     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
   };
-  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.waitSemaphoreCount = headless ? 0 : 1;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
 
@@ -94,15 +153,22 @@ VkResult SwapChain::submitCommandBuffers(
   submitInfo.pCommandBuffers = buffers;
 
   VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.signalSemaphoreCount = headless ? 0 : 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
   vkResetFences( device.device(), 1, &inFlightFences[currentFrame] );
+  submitTimes[currentFrame] = std::chrono::steady_clock::now();
   if ( vkQueueSubmit(
            device.graphicsQueue(), 1, &submitInfo,
            inFlightFences[currentFrame] ) != VK_SUCCESS ) {
     throw std::runtime_error( "failed to submit draw command buffer!" );
   }
+  frameNumbers[currentFrame] = device.endFrame();
+
+  if ( headless ) {
+    currentFrame = ( currentFrame + 1 ) % MAX_FRAMES_IN_FLIGHT;
+    return VK_SUCCESS;
+  }
 
   VkPresentInfoKHR presentInfo = {};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -116,7 +182,24 @@ VkResult SwapChain::submitCommandBuffers(
 
   presentInfo.pImageIndices = imageIndex;
 
+  // tag the present so that its timing can be matched up with the submit
+  VkPresentTimeGOOGLE presentTime{};
+  VkPresentTimesInfoGOOGLE presentTimesInfo{};
+  if ( measuresPresentTime() ) {
+    presentTime.presentID = nextPresentId++;
+    presentTime.desiredPresentTime = 0;
+    presentTimesInfo.sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE;
+    presentTimesInfo.swapchainCount = 1;
+    presentTimesInfo.pTimes = &presentTime;
+    presentInfo.pNext = &presentTimesInfo;
+    pendingPresents.push_back(
+        { presentTime.presentID, submitTimes[currentFrame] } );
+  }
+
+  auto presentStart = clock::now();
   auto result = vkQueuePresentKHR( device.presentQueue(), &presentInfo );
+  timings.present = milliseconds( clock::now() - presentStart ).count();
+  if ( measuresPresentTime() ) collectPresentTimings();
 
   currentFrame = ( currentFrame + 1 ) % MAX_FRAMES_IN_FLIGHT;
 
@@ -124,15 +207,25 @@ VkResult SwapChain::submitCommandBuffers(
 }
 
 void SwapChain::createSwapChain() {
+  if ( device.isHeadless() ) {
+    createOffscreenImages();
+    return;
+  }
+
   SwapChainSupportDetails swapChainSupport = device.getSwapChainSupport();
 
   VkSurfaceFormatKHR surfaceFormat =
       chooseSwapSurfaceFormat( swapChainSupport.formats );
-  VkPresentModeKHR presentMode =
-      chooseSwapPresentMode( swapChainSupport.presentModes );
+  presentMode = chooseSwapPresentMode( swapChainSupport.presentModes );
   VkExtent2D extent = chooseSwapExtent( swapChainSupport.capabilities );
 
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+  // more images let the CPU and GPU run further ahead of the display, at the
+  // cost of latency
+  uint32_t imageCount = settings.imageCount > 0
+                            ? settings.imageCount
+                            : swapChainSupport.capabilities.minImageCount + 1;
+  imageCount =
+      std::max( imageCount, swapChainSupport.capabilities.minImageCount );
   if ( swapChainSupport.capabilities.maxImageCount > 0 &&
        imageCount > swapChainSupport.capabilities.maxImageCount ) {
     imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -191,6 +284,48 @@ void SwapChain::createSwapChain() {
   swapChainExtent = extent;
 }
 
+void SwapChain::createOffscreenImages() {
+  // any format that can be rendered to and copied out of, for readbacks
+  swapChainImageFormat = device.findSupportedFormat(
+      { VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB,
+        VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM },
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT |
+          VK_FORMAT_FEATURE_TRANSFER_SRC_BIT );
+  swapChainExtent = windowExtent;
+
+  // fewer images than frames in flight would have two frames render into
+  // the same image
+  uint32_t imageCount = std::max(
+      settings.imageCount > 0 ? settings.imageCount : HEADLESS_IMAGE_COUNT,
+      uint32_t( MAX_FRAMES_IN_FLIGHT ) );
+  swapChainImages.resize( imageCount );
+  offscreenImageAllocations.resize( imageCount );
+
+  for ( uint32_t i = 0; i < imageCount; i++ ) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = swapChainExtent.width;
+    imageInfo.extent.height = swapChainExtent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = swapChainImageFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.flags = 0;
+
+    device.createImageWithInfo(
+        imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i],
+        offscreenImageAllocations[i] );
+  }
+}
+
 void SwapChain::createImageViews() {
   swapChainImageViews.resize( swapChainImages.size() );
   for ( size_t i = 0; i < swapChainImages.size(); i++ ) {
@@ -215,7 +350,8 @@ void SwapChain::createImageViews() {
 
 void SwapChain::createRenderPass() {
   VkAttachmentDescription depthAttachment{};
-  depthAttachment.format = findDepthFormat();
+  swapChainDepthFormat = findDepthFormat();
+  depthAttachment.format = swapChainDepthFormat;
   depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
   depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -237,7 +373,10 @@ void SwapChain::createRenderPass() {
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  // offscreen images are left ready to be copied out instead of presented
+  colorAttachment.finalLayout = device.isHeadless()
+                                    ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                    : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
   VkAttachmentReference colorAttachmentRef = {};
   colorAttachmentRef.attachment = 0;
@@ -305,14 +444,14 @@ void SwapChain::createFramebuffers() {
 }
 
 void SwapChain::createDepthResources() {
-  VkFormat depthFormat = findDepthFormat();
+  VkFormat depthFormat = swapChainDepthFormat;
   VkExtent2D swapChainExtent = getSwapChainExtent();
 
   depthImages.resize( imageCount() );
-  depthImageMemorys.resize( imageCount() );
+  depthImageAllocations.resize( imageCount() );
   depthImageViews.resize( imageCount() );
 
-  for ( int i = 0; i < depthImages.size(); i++ ) {
+  for ( size_t i = 0; i < depthImages.size(); i++ ) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -331,7 +470,7 @@ void SwapChain::createDepthResources() {
 
     device.createImageWithInfo(
         imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImages[i],
-        depthImageMemorys[i] );
+        depthImageAllocations[i] );
 
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -353,10 +492,32 @@ void SwapChain::createDepthResources() {
 }
 
 void SwapChain::createSyncObjects() {
+  imagesInFlight.resize( imageCount(), VK_NULL_HANDLE );
+
+  // frames submitted through the old swap chain may still be in flight. Its
+  // fences and semaphores are taken over, so that waiting for a frame slot
+  // covers those frames as well
+  if ( oldSwapChain != nullptr ) {
+    imageAvailableSemaphores =
+        std::move( oldSwapChain->imageAvailableSemaphores );
+    renderFinishedSemaphores =
+        std::move( oldSwapChain->renderFinishedSemaphores );
+    inFlightFences = std::move( oldSwapChain->inFlightFences );
+    frameNumbers = std::move( oldSwapChain->frameNumbers );
+    submitTimes = std::move( oldSwapChain->submitTimes );
+    currentFrame = oldSwapChain->currentFrame;
+
+    oldSwapChain->imageAvailableSemaphores.clear();
+    oldSwapChain->renderFinishedSemaphores.clear();
+    oldSwapChain->inFlightFences.clear();
+    return;
+  }
+
   imageAvailableSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
   renderFinishedSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
   inFlightFences.resize( MAX_FRAMES_IN_FLIGHT );
-  imagesInFlight.resize( imageCount(), VK_NULL_HANDLE );
+  frameNumbers.resize( MAX_FRAMES_IN_FLIGHT, 0 );
+  submitTimes.resize( MAX_FRAMES_IN_FLIGHT );
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -396,23 +557,77 @@ VkSurfaceFormatKHR SwapChain::chooseSwapSurfaceFormat(
 VkPresentModeKHR SwapChain::chooseSwapPresentMode(
     const std::vector< VkPresentModeKHR > &availablePresentModes ) {
   for ( const auto &availablePresentMode: availablePresentModes ) {
-    if ( availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR ) {
-      std::cout << "Present mode: Mailbox" << std::endl;
+    if ( availablePresentMode == settings.presentMode ) {
+      std::cout << "Present mode: " << presentModeName( availablePresentMode )
+                << std::endl;
       return availablePresentMode;
     }
   }
 
-  // for ( const auto &availablePresentMode : availablePresentModes) {
-  //   if ( availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-  //     std::cout << "Present mode: Immediate" << std::endl;
-  //     return availablePresentMode;
-  //   }
-  // }
-
-  std::cout << "Present mode: V-Sync" << std::endl;
+  std::cout << "Present mode: " << presentModeName( settings.presentMode )
+            << " not supported, using "
+            << presentModeName( VK_PRESENT_MODE_FIFO_KHR ) << std::endl;
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+const char *SwapChain::presentModeName( VkPresentModeKHR mode ) {
+  switch ( mode ) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "fifo relaxed";
+    default:
+      return "unknown";
+  }
+}
+
+void SwapChain::takeLatencySamples( std::vector< double > &samples ) {
+  samples.insert( samples.end(), latencySamples.begin(), latencySamples.end() );
+  latencySamples.clear();
+}
+
+void SwapChain::collectPresentTimings() {
+  uint32_t count = 0;
+  getPastPresentationTiming( device.device(), swapChain, &count, nullptr );
+  if ( count == 0 ) return;
+
+  std::vector< VkPastPresentationTimingGOOGLE > timings( count );
+  getPastPresentationTiming(
+      device.device(), swapChain, &count, timings.data() );
+
+  for ( uint32_t i = 0; i < count; i++ ) {
+    // images replaced in the mailbox before they were shown never get a
+    // timing, so older presents still waiting are dropped
+    while ( !pendingPresents.empty() &&
+            pendingPresents.front().presentId < timings[i].presentID ) {
+      pendingPresents.pop_front();
+    }
+    if ( pendingPresents.empty() ||
+         pendingPresents.front().presentId != timings[i].presentID )
+      continue;
+
+    // present times are in the clock domain of steady_clock, which is
+    // CLOCK_MONOTONIC on linux; anything else shows up as negative latencies
+    // and is skipped
+    auto submitted = std::chrono::duration_cast< std::chrono::nanoseconds >(
+                         pendingPresents.front().submitTime.time_since_epoch() )
+                         .count();
+    double latency =
+        ( static_cast< double >( timings[i].actualPresentTime ) -
+          static_cast< double >( submitted ) ) /
+        1e6;
+    if ( latency >= 0.0 ) latencySamples.push_back( latency );
+    pendingPresents.pop_front();
+  }
+
+  // a driver that stopped reporting shouldn't make this grow without bound
+  while ( pendingPresents.size() > 64 ) pendingPresents.pop_front();
+}
+
 VkExtent2D SwapChain::chooseSwapExtent(
     const VkSurfaceCapabilitiesKHR &capabilities ) {
   if ( capabilities.currentExtent.width !=
@@ -439,6 +654,13 @@ VkFormat SwapChain::findDepthFormat() {
 }
 
 void SwapChain::init() {
+  if ( device.hasDisplayTiming() && !device.isHeadless() ) {
+    getPastPresentationTiming =
+        reinterpret_cast< PFN_vkGetPastPresentationTimingGOOGLE >(
+            vkGetDeviceProcAddr(
+                device.device(), "vkGetPastPresentationTimingGOOGLE" ) );
+  }
+
   createSwapChain();
   createImageViews();
   createRenderPass();
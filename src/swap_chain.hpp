@@ -6,18 +6,47 @@
 #include <vulkan/vulkan.h>
 
 // std lib headers
+#include <chrono>
+#include <deque>
 #include <memory>
 #include <string>
 #include <vector>
 
 namespace lve {
 
+// what to ask the surface for; changing these takes a new swap chain
+struct SwapChainSettings {
+  // FIFO is used instead if the surface doesn't support the mode, since
+  // every surface supports FIFO
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+  // 0 asks for one more than the surface's minimum. Clamped to what the
+  // surface supports; the size of the offscreen image ring when headless
+  uint32_t imageCount = 0;
+};
+
+// where the CPU spent its time in the swap chain during the last frame, in
+// milliseconds
+struct SwapChainTimings {
+  // waiting for the fence of the frame slot in acquireNextImage
+  double acquireFenceWait = 0.0;
+  // waiting for the frame that last rendered into the image in
+  // submitCommandBuffers
+  double submitFenceWait = 0.0;
+  // in vkQueuePresentKHR
+  double present = 0.0;
+};
+
 class SwapChain {
  public:
   static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-  SwapChain( Device&, VkExtent2D );
-  SwapChain( Device&, VkExtent2D, std::shared_ptr< SwapChain > );
+  // size of the offscreen image ring used in place of a swap chain when the
+  // device is headless
+  static constexpr uint32_t HEADLESS_IMAGE_COUNT = 3;
+
+  SwapChain( Device&, VkExtent2D, SwapChainSettings = SwapChainSettings{} );
+  SwapChain(
+      Device&, VkExtent2D, std::shared_ptr< SwapChain >,
+      SwapChainSettings = SwapChainSettings{} );
   ~SwapChain();
 
   SwapChain( const SwapChain& ) = delete;
@@ -33,6 +62,12 @@ class SwapChain {
   }
 
   VkFormat findDepthFormat();
+  // render passes of swap chains with the same formats are compatible, so
+  // pipelines built for one can be used with the other
+  bool compareSwapFormats( const SwapChain& other ) const {
+    return other.swapChainImageFormat == swapChainImageFormat &&
+           other.swapChainDepthFormat == swapChainDepthFormat;
+  }
 
   VkResult acquireNextImage( uint32_t* );
   VkResult submitCommandBuffers( const VkCommandBuffer*, uint32_t* );
@@ -44,11 +79,28 @@ class SwapChain {
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
   uint32_t width() { return swapChainExtent.width; }
   uint32_t height() { return swapChainExtent.height; }
+  // the frame in flight slot that the next submitCommandBuffers uses
+  size_t getCurrentFrame() { return currentFrame; }
+  // the mode actually in use, which may differ from the one asked for
+  VkPresentModeKHR getPresentMode() { return presentMode; }
+  static const char* presentModeName( VkPresentModeKHR );
+
+  // true if latency samples are measured up to the time an image was
+  // actually presented (VK_GOOGLE_display_timing). Otherwise they only
+  // reach up to the point the CPU saw the frame's fence signaled, which
+  // misses the time the image spends queued for presentation
+  bool measuresPresentTime() { return getPastPresentationTiming != nullptr; }
+  // moves the submit to present latencies in milliseconds measured since
+  // the last call into samples. Present timings arrive a few frames late
+  void takeLatencySamples( std::vector< double >& samples );
+  // reset by every acquireNextImage
+  const SwapChainTimings& getTimings() { return timings; }
 
  private:
   std::shared_ptr< SwapChain > oldSwapChain;
 
   void createSwapChain();
+  void createOffscreenImages();
   void createImageViews();
   void createDepthResources();
   void createRenderPass();
@@ -62,29 +114,51 @@ class SwapChain {
   VkPresentModeKHR chooseSwapPresentMode(
       const std::vector< VkPresentModeKHR >& );
   VkExtent2D chooseSwapExtent( const VkSurfaceCapabilitiesKHR& );
+  void collectPresentTimings();
 
   VkFormat swapChainImageFormat;
+  VkFormat swapChainDepthFormat;
   VkExtent2D swapChainExtent;
 
   std::vector< VkFramebuffer > swapChainFramebuffers;
   VkRenderPass renderPass;
 
   std::vector< VkImage > depthImages;
-  std::vector< VkDeviceMemory > depthImageMemorys;
+  std::vector< Allocation > depthImageAllocations;
   std::vector< VkImageView > depthImageViews;
   std::vector< VkImage > swapChainImages;
   std::vector< VkImageView > swapChainImageViews;
+  // only set when headless; the swap chain owns its images otherwise
+  std::vector< Allocation > offscreenImageAllocations;
+  uint32_t nextOffscreenImage = 0;
 
   Device& device;
   VkExtent2D windowExtent;
+  SwapChainSettings settings;
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
 
-  VkSwapchainKHR swapChain;
+  VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 
   std::vector< VkSemaphore > imageAvailableSemaphores;
   std::vector< VkSemaphore > renderFinishedSemaphores;
   std::vector< VkFence > inFlightFences;
   std::vector< VkFence > imagesInFlight;
+  // the device frame number last submitted with each in flight fence
+  std::vector< uint64_t > frameNumbers;
   size_t currentFrame = 0;
+
+  // when each frame in flight slot was last submitted
+  std::vector< std::chrono::steady_clock::time_point > submitTimes;
+  // presents whose timing hasn't been reported yet, oldest first
+  struct PendingPresent {
+    uint32_t presentId;
+    std::chrono::steady_clock::time_point submitTime;
+  };
+  std::deque< PendingPresent > pendingPresents;
+  uint32_t nextPresentId = 1;
+  PFN_vkGetPastPresentationTimingGOOGLE getPastPresentationTiming = nullptr;
+  std::vector< double > latencySamples;
+  SwapChainTimings timings;
 };
 
 }  // namespace lve
@@ -0,0 +1,160 @@
+#include "telemetry.hpp"
+
+#include "rolling_stats.hpp"
+
+// std headers
+#include <fstream>
+#include <iostream>
+
+namespace lve {
+
+namespace {
+
+// the fields of FrameTelemetry that are summarized and exported, in column
+// order
+struct Field {
+  const char* name;
+  double ( *get )( const FrameTelemetry& );
+};
+
+const Field fields[] = {
+  { "acquire_ms",
+    []( const FrameTelemetry& f ) { return f.acquireMilliseconds; } },
+  { "record_ms",
+    []( const FrameTelemetry& f ) { return f.recordMilliseconds; } },
+  { "submit_ms",
+    []( const FrameTelemetry& f ) { return f.submitMilliseconds; } },
+  { "present_ms",
+    []( const FrameTelemetry& f ) { return f.presentMilliseconds; } },
+  { "acquire_fence_wait_ms",
+    []( const FrameTelemetry& f ) { return f.acquireFenceWaitMilliseconds; } },
+  { "submit_fence_wait_ms",
+    []( const FrameTelemetry& f ) { return f.submitFenceWaitMilliseconds; } },
+  { "draws",
+    []( const FrameTelemetry& f ) {
+      return static_cast< double >( f.drawCount );
+    } },
+  { "upload_bytes",
+    []( const FrameTelemetry& f ) {
+      return static_cast< double >( f.uploadBytes );
+    } },
+};
+
+}  // namespace
+
+Telemetry::Telemetry( size_t _capacity )
+    : capacity{ _capacity }, slots{ new Slot[_capacity] } {}
+
+void Telemetry::record( const FrameTelemetry& frame ) {
+  uint64_t index = written.load( std::memory_order_relaxed );
+  Slot& slot = slots[index % capacity];
+
+  slot.sequence.store( 2 * index + 1, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_release );
+  slot.frame = frame;
+  slot.sequence.store( 2 * index + 2, std::memory_order_release );
+
+  written.store( index + 1, std::memory_order_release );
+}
+
+std::vector< FrameTelemetry > Telemetry::snapshot() const {
+  uint64_t end = written.load( std::memory_order_acquire );
+  uint64_t begin = end > capacity ? end - capacity : 0;
+
+  std::vector< FrameTelemetry > frames;
+  frames.reserve( static_cast< size_t >( end - begin ) );
+  for ( uint64_t i = begin; i < end; i++ ) {
+    const Slot& slot = slots[i % capacity];
+    uint64_t sequence = slot.sequence.load( std::memory_order_acquire );
+    // already overwritten by a newer frame, or being written right now
+    if ( sequence != 2 * i + 2 ) continue;
+
+    FrameTelemetry frame = slot.frame;
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if ( slot.sequence.load( std::memory_order_relaxed ) != sequence )
+      continue;
+
+    frames.push_back( frame );
+  }
+  return frames;
+}
+
+std::vector< TelemetryFieldStats > Telemetry::summarize() const {
+  return summarize( snapshot() );
+}
+
+std::vector< TelemetryFieldStats > Telemetry::summarize(
+    const std::vector< FrameTelemetry >& frames ) {
+  std::vector< TelemetryFieldStats > summary;
+  RollingStats stats{ std::max( frames.size(), size_t( 1 ) ) };
+  for ( const Field& field: fields ) {
+    stats.clear();
+    for ( const auto& frame: frames ) stats.add( field.get( frame ) );
+
+    TelemetryFieldStats fieldStats{ field.name };
+    if ( stats.count() > 0 ) {
+      fieldStats.avg = stats.average();
+      fieldStats.p50 = stats.percentile( 50.0 );
+      fieldStats.p95 = stats.percentile( 95.0 );
+      fieldStats.p99 = stats.percentile( 99.0 );
+      fieldStats.max = stats.max();
+    }
+    summary.push_back( fieldStats );
+  }
+  return summary;
+}
+
+bool Telemetry::writeCsv( const std::string& path ) const {
+  std::ofstream file{ path, std::ios::trunc };
+  if ( !file ) {
+    std::cerr << "failed to write " << path << std::endl;
+    return false;
+  }
+
+  file << "frame";
+  for ( const Field& field: fields ) file << ',' << field.name;
+  file << '\n';
+
+  for ( const auto& frame: snapshot() ) {
+    file << frame.frame;
+    for ( const Field& field: fields ) file << ',' << field.get( frame );
+    file << '\n';
+  }
+  return true;
+}
+
+bool Telemetry::writeJson( const std::string& path ) const {
+  std::ofstream file{ path, std::ios::trunc };
+  if ( !file ) {
+    std::cerr << "failed to write " << path << std::endl;
+    return false;
+  }
+
+  // the summary covers exactly the frames listed below it
+  std::vector< FrameTelemetry > frames = snapshot();
+
+  file << "{\n  \"recorded_frames\": " << getRecordedFrames()
+       << ",\n  \"summary\": {";
+  const char* separator = "\n";
+  for ( const auto& stats: summarize( frames ) ) {
+    file << separator << "    \"" << stats.name << "\": { \"avg\": "
+         << stats.avg << ", \"p50\": " << stats.p50
+         << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99
+         << ", \"max\": " << stats.max << " }";
+    separator = ",\n";
+  }
+
+  file << "\n  },\n  \"frames\": [";
+  separator = "\n";
+  for ( const auto& frame: frames ) {
+    file << separator << "    { \"frame\": " << frame.frame;
+    for ( const Field& field: fields )
+      file << ", \"" << field.name << "\": " << field.get( frame );
+    file << " }";
+    separator = ",\n";
+  }
+  file << "\n  ]\n}\n";
+  return true;
+}
+
+}  // namespace lve
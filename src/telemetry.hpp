@@ -0,0 +1,80 @@
+#pragma once
+
+// std lib headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lve {
+
+// what the CPU did for one frame. Times are in milliseconds
+struct FrameTelemetry {
+  uint64_t frame = 0;
+  double acquireMilliseconds = 0.0;
+  double recordMilliseconds = 0.0;
+  // vkQueueSubmit and what comes with it, without the present
+  double submitMilliseconds = 0.0;
+  double presentMilliseconds = 0.0;
+  // part of acquire/submit spent blocked in vkWaitForFences
+  double acquireFenceWaitMilliseconds = 0.0;
+  double submitFenceWaitMilliseconds = 0.0;
+  uint32_t drawCount = 0;
+  // instance and object data written to per frame buffers
+  uint64_t uploadBytes = 0;
+};
+
+struct TelemetryFieldStats {
+  const char* name;
+  double avg = 0.0;
+  double p50 = 0.0;
+  double p95 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+// keeps the last frames' telemetry in a fixed ring. Only the render thread
+// records; snapshots, summaries and exports may be taken from any thread
+// without locking or stalling it. Every slot carries a sequence number that
+// is odd while the slot is being written, a reader copies a slot and then
+// checks that its sequence didn't change (a seqlock); slots overwritten
+// while being read are left out of the snapshot
+class Telemetry {
+ public:
+  static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+  explicit Telemetry( size_t capacity = DEFAULT_CAPACITY );
+  Telemetry( const Telemetry& ) = delete;
+  Telemetry& operator=( const Telemetry& ) = delete;
+
+  void record( const FrameTelemetry& frame );
+
+  // the frames still in the ring, oldest first
+  std::vector< FrameTelemetry > snapshot() const;
+  uint64_t getRecordedFrames() const {
+    return written.load( std::memory_order_acquire );
+  }
+
+  // one entry per field of FrameTelemetry, over the frames in the ring
+  std::vector< TelemetryFieldStats > summarize() const;
+
+  bool writeCsv( const std::string& path ) const;
+  bool writeJson( const std::string& path ) const;
+
+ private:
+  struct Slot {
+    std::atomic< uint64_t > sequence{ 0 };
+    FrameTelemetry frame;
+  };
+
+  static std::vector< TelemetryFieldStats > summarize(
+      const std::vector< FrameTelemetry >& frames );
+
+  size_t capacity;
+  std::unique_ptr< Slot[] > slots;
+  std::atomic< uint64_t > written{ 0 };
+};
+
+}  // namespace lve
@@ -0,0 +1,259 @@
+#include "upload_batch.hpp"
+
+// std headers
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+namespace lve {
+
+UploadBatch::UploadBatch( Device& _device ) : device{ _device } {}
+
+UploadBatch::~UploadBatch() {
+  if ( !empty() ) flush();
+}
+
+StagingRegion UploadBatch::stage(
+    const void* data, VkDeviceSize size, VkDeviceSize alignment ) {
+  StagingRegion region;
+
+  // the ring may be full of copies that only this batch knows about; those
+  // have to be submitted before waiting on the GPU can free up any space
+  if ( !device.tryAcquireStagingRegion( size, alignment, region ) ) {
+    if ( !empty() ) flush();
+    region = device.acquireStagingRegion( size, alignment );
+  }
+
+  memcpy( region.data, data, static_cast< size_t >( size ) );
+  return region;
+}
+
+void UploadBatch::uploadToBuffer(
+    VkBuffer dstBuffer, const void* data, VkDeviceSize size,
+    VkDeviceSize dstOffset ) {
+  const char* bytes = static_cast< const char* >( data );
+
+  // anything larger than half the ring is split up, so that one chunk can be
+  // filled while the previous one is still being copied
+  const VkDeviceSize maxChunk = device.stagingCapacity() / 2;
+
+  while ( size > 0 ) {
+    VkDeviceSize chunk = std::min( size, maxChunk );
+
+    // buffer copies have no alignment requirements; keeping them tightly
+    // packed lets consecutive uploads into one buffer merge into one region
+    StagingRegion region = stage( bytes, chunk, 4 );
+    copyBuffer( region.buffer, dstBuffer, chunk, region.offset, dstOffset );
+
+    bytes += chunk;
+    dstOffset += chunk;
+    size -= chunk;
+  }
+}
+
+void UploadBatch::uploadToImage(
+    VkImage image, const void* data, VkDeviceSize size, uint32_t width,
+    uint32_t height, uint32_t layerCount ) {
+  // bufferOffset has to be a multiple of the texel size and of 4
+  StagingRegion region = stage( data, size, 16 );
+  copyBufferToImage(
+      region.buffer, image, width, height, layerCount, region.offset );
+}
+
+void UploadBatch::copyBuffer(
+    VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size,
+    VkDeviceSize srcOffset, VkDeviceSize dstOffset ) {
+  if ( empty() ) device.countUnflushedBatch( true );
+  BufferCopy copy{};
+  copy.src = srcBuffer;
+  copy.dst = dstBuffer;
+  copy.region.srcOffset = srcOffset;
+  copy.region.dstOffset = dstOffset;
+  copy.region.size = size;
+  bufferCopies.push_back( copy );
+}
+
+void UploadBatch::copyBufferToImage(
+    VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
+    uint32_t layerCount, VkDeviceSize bufferOffset ) {
+  if ( empty() ) device.countUnflushedBatch( true );
+  ImageCopy copy{};
+  copy.src = buffer;
+  copy.dst = image;
+  copy.region.bufferOffset = bufferOffset;
+  copy.region.bufferRowLength = 0;
+  copy.region.bufferImageHeight = 0;
+
+  copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  copy.region.imageSubresource.mipLevel = 0;
+  copy.region.imageSubresource.baseArrayLayer = 0;
+  copy.region.imageSubresource.layerCount = layerCount;
+
+  copy.region.imageOffset = { 0, 0, 0 };
+  copy.region.imageExtent = { width, height, 1 };
+  imageCopies.push_back( copy );
+}
+
+UploadTicket UploadBatch::flush() {
+  if ( empty() ) return ticket;
+
+  VkCommandBuffer commandBuffer = device.beginTransferCommands();
+
+  // images start out undefined and have to be in TRANSFER_DST layout for the
+  // copy. One transition per image, no matter how many regions it gets
+  std::vector< VkImage > images;
+  for ( const auto& copy: imageCopies ) images.push_back( copy.dst );
+  std::sort( images.begin(), images.end() );
+  images.erase( std::unique( images.begin(), images.end() ), images.end() );
+
+  std::vector< VkImageMemoryBarrier > imageBarriers( images.size() );
+  for ( size_t i = 0; i < images.size(); i++ ) {
+    VkImageMemoryBarrier& barrier = imageBarriers[i];
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = images[i];
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  }
+
+  if ( !imageBarriers.empty() ) {
+    vkCmdPipelineBarrier(
+        commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+        static_cast< uint32_t >( imageBarriers.size() ),
+        imageBarriers.data() );
+    stats.barriers += static_cast< uint32_t >( imageBarriers.size() );
+  }
+
+  // buffer copies: sort so that copies between the same pair of buffers are
+  // next to each other and in order, then merge those that continue where
+  // the previous one left off in both buffers
+  std::sort(
+      bufferCopies.begin(), bufferCopies.end(),
+      []( const BufferCopy& a, const BufferCopy& b ) {
+        return std::tie( a.src, a.dst, a.region.srcOffset ) <
+               std::tie( b.src, b.dst, b.region.srcOffset );
+      } );
+
+  std::vector< VkBufferCopy > regions;
+  std::vector< VkBufferMemoryBarrier > bufferBarriers;
+
+  for ( size_t i = 0; i < bufferCopies.size(); ) {
+    VkBuffer src = bufferCopies[i].src;
+    VkBuffer dst = bufferCopies[i].dst;
+    regions.clear();
+
+    for ( ; i < bufferCopies.size() && bufferCopies[i].src == src &&
+            bufferCopies[i].dst == dst;
+          i++ ) {
+      const VkBufferCopy& region = bufferCopies[i].region;
+      stats.bytes += region.size;
+
+      if ( !regions.empty() &&
+           regions.back().srcOffset + regions.back().size ==
+               region.srcOffset &&
+           regions.back().dstOffset + regions.back().size ==
+               region.dstOffset ) {
+        regions.back().size += region.size;
+      } else {
+        regions.push_back( region );
+      }
+    }
+
+    vkCmdCopyBuffer(
+        commandBuffer, src, dst, static_cast< uint32_t >( regions.size() ),
+        regions.data() );
+    stats.recordedRegions += static_cast< uint32_t >( regions.size() );
+
+    for ( const auto& region: regions ) {
+      VkBufferMemoryBarrier barrier{};
+      barrier.buffer = dst;
+      barrier.offset = region.dstOffset;
+      barrier.size = region.size;
+      bufferBarriers.push_back( barrier );
+    }
+  }
+
+  // the same destination range may have been written from different
+  // sources; one barrier per contiguous range of each buffer is enough
+  std::sort(
+      bufferBarriers.begin(), bufferBarriers.end(),
+      []( const VkBufferMemoryBarrier& a, const VkBufferMemoryBarrier& b ) {
+        return std::tie( a.buffer, a.offset ) < std::tie( b.buffer, b.offset );
+      } );
+
+  std::vector< VkBufferMemoryBarrier > mergedBarriers;
+  for ( const auto& barrier: bufferBarriers ) {
+    if ( !mergedBarriers.empty() &&
+         mergedBarriers.back().buffer == barrier.buffer &&
+         mergedBarriers.back().offset + mergedBarriers.back().size >=
+             barrier.offset ) {
+      VkDeviceSize end = std::max(
+          mergedBarriers.back().offset + mergedBarriers.back().size,
+          barrier.offset + barrier.size );
+      mergedBarriers.back().size = end - mergedBarriers.back().offset;
+    } else {
+      mergedBarriers.push_back( barrier );
+    }
+  }
+
+  // image copies can't be merged, but all regions for one image still go
+  // into a single command
+  std::stable_sort(
+      imageCopies.begin(), imageCopies.end(),
+      []( const ImageCopy& a, const ImageCopy& b ) {
+        return std::tie( a.src, a.dst ) < std::tie( b.src, b.dst );
+      } );
+
+  std::vector< VkBufferImageCopy > imageRegions;
+  for ( size_t i = 0; i < imageCopies.size(); ) {
+    VkBuffer src = imageCopies[i].src;
+    VkImage dst = imageCopies[i].dst;
+    imageRegions.clear();
+
+    for ( ; i < imageCopies.size() && imageCopies[i].src == src &&
+            imageCopies[i].dst == dst;
+          i++ ) {
+      const VkBufferImageCopy& region = imageCopies[i].region;
+      // tightly packed 4 byte texels is an estimate; the format isn't known
+      stats.bytes += static_cast< VkDeviceSize >( region.imageExtent.width ) *
+                     region.imageExtent.height *
+                     region.imageSubresource.layerCount * 4;
+      imageRegions.push_back( region );
+    }
+
+    vkCmdCopyBufferToImage(
+        commandBuffer, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast< uint32_t >( imageRegions.size() ), imageRegions.data() );
+    stats.recordedRegions += static_cast< uint32_t >( imageRegions.size() );
+  }
+
+  // afterwards the images are handed to the shaders
+  for ( auto& barrier: imageBarriers ) {
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
+
+  stats.requestedRegions +=
+      static_cast< uint32_t >( bufferCopies.size() + imageCopies.size() );
+  stats.barriers +=
+      static_cast< uint32_t >( mergedBarriers.size() + imageBarriers.size() );
+  stats.submissions++;
+
+  ticket = device.submitUpload( commandBuffer, mergedBarriers, imageBarriers );
+
+  bufferCopies.clear();
+  imageCopies.clear();
+  device.countUnflushedBatch( false );
+  return ticket;
+}
+
+}  // namespace lve
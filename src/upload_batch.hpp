@@ -0,0 +1,83 @@
+#pragma once
+
+#include "device.hpp"
+
+// std lib headers
+#include <vector>
+
+namespace lve {
+
+struct UploadBatchStats {
+  VkDeviceSize bytes = 0;
+  // copies as requested by the caller
+  uint32_t requestedRegions = 0;
+  // copies actually recorded after merging neighbouring ones
+  uint32_t recordedRegions = 0;
+  uint32_t barriers = 0;
+  uint32_t submissions = 0;
+};
+
+// gathers many small copies and submits all of them at once on the transfer
+// queue. Copies that share a source and destination and are contiguous in
+// both are merged into a single region, and the barriers for each
+// destination are only recorded once per flush.
+//
+// Sources of copyBuffer/copyBufferToImage must be host written buffers that
+// are not owned by another queue family, e.g. the staging ring itself.
+class UploadBatch {
+ public:
+  UploadBatch( Device& );
+  ~UploadBatch();
+  UploadBatch( const UploadBatch& ) = delete;
+  UploadBatch& operator=( const UploadBatch& ) = delete;
+
+  // copies host data into the staging ring right away and queues the
+  // ring -> buffer copy
+  void uploadToBuffer(
+      VkBuffer dstBuffer, const void* data, VkDeviceSize size,
+      VkDeviceSize dstOffset = 0 );
+  void uploadToImage(
+      VkImage image, const void* data, VkDeviceSize size, uint32_t width,
+      uint32_t height, uint32_t layerCount );
+
+  void copyBuffer(
+      VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size,
+      VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0 );
+  // the image is expected to be in VK_IMAGE_LAYOUT_UNDEFINED, and is left in
+  // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+  void copyBufferToImage(
+      VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
+      uint32_t layerCount, VkDeviceSize bufferOffset = 0 );
+
+  // records and submits everything gathered so far in one submission. The
+  // ticket covers this flush and any earlier ones
+  UploadTicket flush();
+
+  bool empty() const { return bufferCopies.empty() && imageCopies.empty(); }
+  // totals over every flush of this batch
+  const UploadBatchStats& getStats() const { return stats; }
+  UploadTicket getTicket() const { return ticket; }
+
+ private:
+  struct BufferCopy {
+    VkBuffer src;
+    VkBuffer dst;
+    VkBufferCopy region;
+  };
+
+  struct ImageCopy {
+    VkBuffer src;
+    VkImage dst;
+    VkBufferImageCopy region;
+  };
+
+  Device& device;
+  std::vector< BufferCopy > bufferCopies;
+  std::vector< ImageCopy > imageCopies;
+  UploadBatchStats stats;
+  UploadTicket ticket;
+
+  StagingRegion stage( const void* data, VkDeviceSize size, VkDeviceSize );
+};
+
+}  // namespace lve
@@ -38,6 +38,7 @@ void Window::initWindow() {
       glfwCreateWindow( width, height, windowName.c_str(), nullptr, nullptr );
   glfwSetWindowUserPointer( window, this );
   glfwSetFramebufferSizeCallback( window, framebufferResizeCallback );
+  glfwSetKeyCallback( window, keyCallback );
 }
 
 void Window::framebufferResizeCallback(
@@ -49,4 +50,11 @@ void Window::framebufferResizeCallback(
   resizedWindow->height = height;
 }
 
+void Window::keyCallback(
+    GLFWwindow* window, int key, int scancode, int action, int mods ) {
+  if ( action != GLFW_PRESS ) return;
+  auto keyWindow = static_cast< Window* >( glfwGetWindowUserPointer( window ) );
+  keyWindow->keyPresses.push_back( key );
+}
+
 }  // namespace lve
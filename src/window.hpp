@@ -4,6 +4,7 @@
 #include <GLFW/glfw3.h>
 
 #include <string>
+#include <vector>
 
 namespace lve {
 
@@ -18,8 +19,11 @@ class Window {
   std::string windowName;
 
   GLFWwindow* window;
+  // keys pressed since the last takeKeyPresses
+  std::vector< int > keyPresses;
 
   static void framebufferResizeCallback( GLFWwindow*, int, int );
+  static void keyCallback( GLFWwindow*, int, int, int, int );
 
  public:
   Window( int, int, std::string );
@@ -30,6 +34,12 @@ class Window {
   bool shouldClose() { return glfwWindowShouldClose( window ); }
   bool wasResized() { return windowResized; }
   void resetResizedFlag() { windowResized = false; }
+  // GLFW_KEY_* codes in the order they were pressed
+  std::vector< int > takeKeyPresses() {
+    std::vector< int > keys;
+    keys.swap( keyPresses );
+    return keys;
+  }
 
   VkExtent2D getExtent() {
     return { static_cast< uint32_t >( width ),